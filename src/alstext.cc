@@ -116,9 +116,42 @@ namespace fasttext {
 
   }
 
+  void ALSText::saveCheckpoint(int32_t epoch, bool best, bool blocking) {
+    TrainState state;
+    state.epoch = epoch;
+    state.tokenCount = tokenCount_->total();
+    state.bestLoss = bestLoss_;
+    state.positions = positions_.snapshot();
+    std::shared_ptr<Args> args = args_;
+    std::shared_ptr<Dictionary> first_dict = first_dict_;
+    std::shared_ptr<Dictionary> second_dict = second_dict_;
+    Checkpointer::Writer writeModel =
+        [args, first_dict, second_dict](std::ostream& out,
+                                        const Checkpointer::Matrices& m) {
+          args->save(out);
+          first_dict->save(out);
+          m[0]->save(out);
+          m[1]->save(out);
+          second_dict->save(out);
+          m[2]->save(out);
+          m[3]->save(out);
+        };
+    Checkpointer::Jobs jobs;
+    jobs.push_back(std::make_pair(args_->output + ".ckpt",
+        [writeModel, state](std::ostream& out,
+                            const Checkpointer::Matrices& m) {
+          writeModel(out, m);
+          state.save(out);
+        }));
+    if (best) {
+      jobs.push_back(std::make_pair(args_->output + ".bin", writeModel));
+    }
+    checkpointer_->save(jobs, blocking);
+  }
+
   void ALSText::printInfo(real progress, real loss) {
     real t = real(clock() - start) / CLOCKS_PER_SEC;
-    real wst = real(tokenCount) / t;
+    real wst = real(tokenCount_->total()) / t;
     real lr = args_->lr * (1.0 - progress);
     int eta = int(t / progress * (1 - progress) / args_->thread);
     int etah = eta / 3600;
@@ -296,13 +329,17 @@ namespace fasttext {
   }
   void ALSText::trainThread(int32_t threadId) {
     std::ifstream ifs(args_->input);
-    utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
     int64_t endPos = std::min(utils::size(ifs), (threadId + 1) * utils::size(ifs) / args_->thread);
+    if (positions_.get(threadId) >= 0) {
+      utils::seek(ifs, positions_.get(threadId));
+    } else {
+      utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
 
-    // 去掉第一个不完整的样本
-    std::string line;
-    while (getline(ifs, line)) {
-      if (line == "REFUSE" || line == "INTERVIEW" || line == "ACCEPT_INTERVIEW") break;
+      // 去掉第一个不完整的样本
+      std::string line;
+      while (getline(ifs, line)) {
+        if (line == "REFUSE" || line == "INTERVIEW" || line == "ACCEPT_INTERVIEW") break;
+      }
     }
     ALSModel model(first_embedding_, first_w1_, second_embedding_, second_w1_, args_, threadId);
 
@@ -311,8 +348,11 @@ namespace fasttext {
     std::vector<int32_t> first_words, second_words;
     bool label;
     real weight = 1.0;
+    const int64_t ntokens = args_->epoch * numToken;
+    // other threads are assumed to progress at the same pace between reads
+    int64_t tokenCount = tokenCount_->total();
     while (ifs.tellg() > 0 && ifs.tellg() < endPos) {
-      real progress = real(tokenCount) / (args_->epoch * numToken);
+      real progress = real(tokenCount + localTokenCount * args_->thread) / ntokens;
       real lr = args_->lr * (1.0 - progress);
 
       getline(ifs, first);
@@ -331,13 +371,23 @@ namespace fasttext {
       supervised(model, lr, first_words, second_words, label, weight);
 
       if (localTokenCount > args_->lrUpdateRate) {
-        tokenCount += localTokenCount;
+        tokenCount_->add(threadId, localTokenCount);
+        tokenCount = tokenCount_->total();
         localTokenCount = 0;
+        if (checkpointer_) {
+          positions_.track(threadId, ifs);
+          if (threadId == 0 && checkpointer_->due()) {
+            saveCheckpoint(epoch_, false, false);
+          }
+        }
         if (threadId == 0 && args_->verbose > 1) {
           printInfo(progress, model.getLoss());
         }
       }
     }
+    if (checkpointer_) {
+      positions_.set(threadId, endPos);
+    }
     ifs.close();
   }
 
@@ -372,7 +422,8 @@ namespace fasttext {
 
     dict->threshold(1, 0);
     embedding = std::make_shared<Matrix>(dict->nwords()+args_->bucket, args_->dim);
-    embedding->uniform(1.0 / args_->dim);
+    embedding->lazyUniform(1.0 / args_->dim,
+                           args_->lazyBuckets ? dict->nwords() : embedding->m_);
 
     for (size_t i = 0; i < n; i++) {
       int32_t idx = dict->getId(words[i]);
@@ -472,32 +523,64 @@ namespace fasttext {
   }
 
   void ALSText::train(std::shared_ptr<Args> args) {
-    args_ = args;
-    first_dict_ = std::make_shared<Dictionary>(args_);
-    second_dict_ = std::make_shared<Dictionary>(args_);
-    if (args_->input == "-") {
+    Matrix::hugePages = args->hugePages;
+    if (args->input == "-") {
       // manage expectations
       std::cerr << "Cannot use stdin for training!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    std::ifstream first_fs(args_->dict + ".first");
-    if (!first_fs.is_open()) {
-      std::cerr << "Input file " << args_->dict << ".first" << " cannot be opened!" << std::endl;
-      exit(EXIT_FAILURE);
-    }
-    first_dict_->build(first_fs);
-    first_fs.close();
+    TrainState state;
+    if (!args->resume.empty()) {
+      std::ifstream ckpt_fs(args->resume, std::ifstream::binary);
+      if (!ckpt_fs.is_open()) {
+        std::cerr << "Checkpoint file cannot be opened for resuming!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      loadModel(ckpt_fs);
+      args->restore(*args_);
+      args_ = args;
+      if (!state.load(ckpt_fs)) {
+        std::cerr << "Checkpoint file has no training state!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      ckpt_fs.close();
+    } else {
+      args_ = args;
+      first_dict_ = std::make_shared<Dictionary>(args_);
+      second_dict_ = std::make_shared<Dictionary>(args_);
+      std::ifstream first_fs(args_->dict + ".first");
+      if (!first_fs.is_open()) {
+        std::cerr << "Input file " << args_->dict << ".first" << " cannot be opened!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      first_dict_->build(first_fs);
+      first_fs.close();
 
-    std::cout << "first dict " << first_dict_->nwords() << std::endl;
+      std::cout << "first dict " << first_dict_->nwords() << std::endl;
 
-    std::ifstream second_fs(args_->dict + ".second");
-    if (!second_fs.is_open()) {
-      std::cerr << "Input file " << args_->dict << ".second" << " cannot be opened!" << std::endl;
-      exit(EXIT_FAILURE);
+      std::ifstream second_fs(args_->dict + ".second");
+      if (!second_fs.is_open()) {
+        std::cerr << "Input file " << args_->dict << ".second" << " cannot be opened!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      second_dict_->build(second_fs);
+      second_fs.close();
+      std::cout << "second dict " << second_dict_->nwords() << std::endl;
+
+      first_embedding_ = std::make_shared<Matrix>(first_dict_->nwords() + args_->bucket, args_->dim);
+      first_embedding_->lazyUniform(1.0 / args_->dim,
+                                    args_->lazyBuckets ? first_dict_->nwords() : first_embedding_->m_);
+
+      second_embedding_ = std::make_shared<Matrix>(second_dict_->nwords() + args_->bucket, args_->dim);
+      second_embedding_->lazyUniform(1.0 / args_->dim,
+                                     args_->lazyBuckets ? second_dict_->nwords() : second_embedding_->m_);
+
+      first_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
+      second_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
+
+      first_w1_->uniform(1.0 / args_->dim);
+      second_w1_->uniform(1.0 / args_->dim);
     }
-    second_dict_->build(second_fs);
-    second_fs.close();
-    std::cout << "second dict " << second_dict_->nwords() << std::endl;
 
     std::ifstream train_fs(args_->input);
     if (!train_fs.is_open()) {
@@ -514,24 +597,21 @@ namespace fasttext {
       numToken += second_dict_->getLine(second, second_words, rng);
     }
     std::cout << "Total number of token: " << numToken << std::endl;
-    second_fs.close();
-
-    first_embedding_ = std::make_shared<Matrix>(first_dict_->nwords() + args_->bucket, args_->dim);
-    first_embedding_->uniform(1.0 / args_->dim);
-
-    second_embedding_ = std::make_shared<Matrix>(second_dict_->nwords() + args_->bucket, args_->dim);
-    second_embedding_->uniform(1.0 / args_->dim);
-
-    first_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
-    second_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
-
-    first_w1_->uniform(1.0 / args_->dim);
-    second_w1_->uniform(1.0 / args_->dim);
+    train_fs.close();
 
     start = clock();
-    tokenCount = 0;
-    real minValidLoss = std::numeric_limits<real>::max();
-    for (int32_t epoch = 0; epoch < args_->epoch; epoch++) {
+    tokenCount_ = std::make_shared<ProgressCounter>(args_->thread,
+                                                    state.tokenCount);
+    bestLoss_ = state.bestLoss;
+    positions_.reset(args_->thread, state.positions);
+    if (args_->checkpointInterval > 0) {
+      checkpointer_ = std::make_shared<Checkpointer>(
+          Checkpointer::Matrices{first_embedding_, first_w1_,
+                                 second_embedding_, second_w1_},
+          args_->checkpointInterval);
+    }
+    for (int32_t epoch = state.epoch; epoch < args_->epoch; epoch++) {
+      epoch_ = epoch;
       // train
       std::vector<std::thread> threads;
       for (int32_t i = 0; i < args_->thread; i++) {
@@ -540,25 +620,32 @@ namespace fasttext {
       for (auto it = threads.begin(); it != threads.end(); ++it) {
         it->join();
       }
+      positions_.reset(args_->thread);
       // valid
       real validLoss = valid();
       std::cout << "\nepoch = " << epoch << "  valid loss = " << validLoss << std::endl;
-      if (validLoss < minValidLoss) {
+      bool best = validLoss < bestLoss_;
+      if (best) {
         model_ = std::make_shared<ALSModel>(first_embedding_,
                                              first_w1_,
                                              second_embedding_,
                                              second_w1_,
                                              args_, 0);
-
+        bestLoss_ = validLoss;
+      }
+      // the snapshot is written in background while the next epoch runs
+      if (checkpointer_) {
+        saveCheckpoint(epoch + 1, best, true);
+      } else if (best) {
         saveModel();
-        if (args_->model != model_name::sup) {
-          saveVectors();
-        }
-        minValidLoss = std::min(minValidLoss, validLoss);
+      }
+      if (best && args_->model != model_name::sup) {
+        saveVectors();
       }
     }
-
-
+    if (checkpointer_) {
+      checkpointer_->wait();
+    }
   }
 
 }
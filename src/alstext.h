@@ -10,6 +10,8 @@
 #include <atomic>
 #include <memory>
 #include <future>
+#include "checkpoint.h"
+#include "progress.h"
 #include "matrix.h"
 #include "vector.h"
 #include "dictionary.h"
@@ -36,9 +38,13 @@ private:
   std::shared_ptr<Matrix> second_w1_;
 
   std::shared_ptr<ALSModel> model_;
-  std::atomic<int64_t> tokenCount;
+  std::shared_ptr<ProgressCounter> tokenCount_;
   std::atomic<int64_t> numToken;
   clock_t start;
+  std::shared_ptr<Checkpointer> checkpointer_;
+  FilePositions positions_;
+  int32_t epoch_;
+  real bestLoss_;
 
 private:
   void getVector(std::shared_ptr<Dictionary>,
@@ -61,6 +67,7 @@ public:
   void saveModel();
   void loadModel(const std::string&);
   void loadModel(std::istream&);
+  void saveCheckpoint(int32_t, bool, bool);
   void printInfo(real, real);
 
   void supervised(ALSModel&, real,
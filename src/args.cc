@@ -39,6 +39,25 @@ Args::Args() {
   label = "__label__";
   verbose = 2;
   pretrainedVectors = "";
+  checkpointInterval = 0;
+  resume = "";
+  validInterval = 10;
+  patience = 0;
+  numa = 0;
+  numaSync = 1000;
+  hotRows = 0;
+  flushRate = 100;
+  sharedNegatives = 0;
+  ioThread = 0;
+  prefetch = 4;
+  hugePages = 0;
+  lazyBuckets = 1;
+  workers = 1;
+  rank = 0;
+  master = "127.0.0.1:7777";
+  syncInterval = 1000;
+  syncSparse = 1;
+  beam = 0;
 }
 
 void Args::parseArgs(int argc, char** argv) {
@@ -107,6 +126,10 @@ void Args::parseArgs(int argc, char** argv) {
         loss = loss_name::ns;
       } else if (strcmp(argv[ai + 1], "softmax") == 0) {
         loss = loss_name::softmax;
+      } else if (strcmp(argv[ai + 1], "adaptive") == 0) {
+        loss = loss_name::adaptive;
+      } else if (strcmp(argv[ai + 1], "sampled") == 0) {
+        loss = loss_name::sampled;
       } else {
         std::cout << "Unknown loss: " << argv[ai + 1] << std::endl;
         printHelp();
@@ -128,6 +151,44 @@ void Args::parseArgs(int argc, char** argv) {
       verbose = atoi(argv[ai + 1]);
     } else if (strcmp(argv[ai], "-pretrainedVectors") == 0) {
       pretrainedVectors = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-checkpointInterval") == 0) {
+      checkpointInterval = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-resume") == 0) {
+      resume = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-validInterval") == 0) {
+      validInterval = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-patience") == 0) {
+      patience = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-numa") == 0) {
+      numa = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-numaSync") == 0) {
+      numaSync = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-hotRows") == 0) {
+      hotRows = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-flushRate") == 0) {
+      flushRate = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-sharedNegatives") == 0) {
+      sharedNegatives = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-ioThread") == 0) {
+      ioThread = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-prefetch") == 0) {
+      prefetch = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-hugePages") == 0) {
+      hugePages = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-beam") == 0) {
+      beam = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-lazyBuckets") == 0) {
+      lazyBuckets = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-workers") == 0) {
+      workers = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-rank") == 0) {
+      rank = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-master") == 0) {
+      master = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-syncInterval") == 0) {
+      syncInterval = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-syncSparse") == 0) {
+      syncSparse = atoi(argv[ai + 1]);
     } else {
       std::cout << "Unknown argument: " << argv[ai] << std::endl;
       printHelp();
@@ -145,10 +206,22 @@ void Args::parseArgs(int argc, char** argv) {
   }
 }
 
+static std::string lossName(loss_name loss) {
+  if (loss == loss_name::hs) return "hs";
+  if (loss == loss_name::softmax) return "softmax";
+  if (loss == loss_name::adaptive) return "adaptive";
+  if (loss == loss_name::sampled) return "sampled";
+  return "ns";
+}
+
+static std::string modelName(model_name model) {
+  if (model == model_name::cbow) return "cbow";
+  if (model == model_name::sg) return "skipgram";
+  return "supervised";
+}
+
 void Args::printHelp() {
-  std::string lname = "ns";
-  if (loss == loss_name::hs) lname = "hs";
-  if (loss == loss_name::softmax) lname = "softmax";
+  std::string lname = lossName(loss);
   std::cout
     << "\n"
     << "The following arguments are mandatory:\n"
@@ -164,7 +237,7 @@ void Args::printHelp() {
     << "  -minCountLabel      minimal number of label occurences [" << minCountLabel << "]\n"
     << "  -neg                number of negatives sampled [" << neg << "]\n"
     << "  -wordNgrams         max length of word ngram [" << wordNgrams << "]\n"
-    << "  -loss               loss function {ns, hs, softmax} [ns]\n"
+    << "  -loss               loss function {ns, hs, softmax, adaptive, sampled} [" << lname << "]\n"
     << "  -bucket             number of buckets [" << bucket << "]\n"
     << "  -minn               min length of char ngram [" << minn << "]\n"
     << "  -maxn               max length of char ngram [" << maxn << "]\n"
@@ -172,10 +245,65 @@ void Args::printHelp() {
     << "  -t                  sampling threshold [" << t << "]\n"
     << "  -label              labels prefix [" << label << "]\n"
     << "  -verbose            verbosity level [" << verbose << "]\n"
-    << "  -pretrainedVectors  pretrained word vectors for supervised learning []"
+    << "  -pretrainedVectors  pretrained word vectors for supervised learning []\n"
+    << "  -checkpointInterval seconds between background checkpoints, 0 to disable [" << checkpointInterval << "]\n"
+    << "  -resume             checkpoint file to resume training from []\n"
+    << "  -valid              validation file path, keeps the best supervised model []\n"
+    << "  -validInterval      seconds between validations [" << validInterval << "]\n"
+    << "  -patience           validations without improvement before stopping, 0 to disable [" << patience << "]\n"
+    << "  -numa               bind threads to NUMA nodes and train one model replica per node [" << numa << "]\n"
+    << "  -numaSync           milliseconds between averaging NUMA replicas [" << numaSync << "]\n"
+    << "  -hotRows            rows per matrix buffered per thread for frequent words, 0 to disable [" << hotRows << "]\n"
+    << "  -flushRate          examples between flushes of buffered rows [" << flushRate << "]\n"
+    << "  -sharedNegatives    share one set of negatives across a skipgram window [" << sharedNegatives << "]\n"
+    << "  -ioThread           threads reading and tokenizing the input, 0 to read in the training threads [" << ioThread << "]\n"
+    << "  -prefetch           rows prefetched ahead when gathering or updating rows, 0 to disable [" << prefetch << "]\n"
+    << "  -hugePages          back large matrices with huge pages: 0 off, 1 transparent, 2 hugetlbfs with fallback to 1 [" << hugePages << "]\n"
+    << "  -beam               tree nodes kept while predicting with hs, 0 for the exact top k [" << beam << "]\n"
+    << "  -lazyBuckets        initialize n-gram bucket rows when first used instead of up front [" << lazyBuckets << "]\n"
+    << "  -workers            number of cooperating training processes [" << workers << "]\n"
+    << "  -rank               rank of this process, rank 0 merges and saves the model [" << rank << "]\n"
+    << "  -master             host:port or unix:path where rank 0 listens [" << master << "]\n"
+    << "  -syncInterval       milliseconds between merges across processes [" << syncInterval << "]\n"
+    << "  -syncSparse         merge only the rows written since the last merge [" << syncSparse << "]"
     << std::endl;
 }
 
+template <typename T>
+static void restoreArg(const std::string& name, T& value, const T& saved) {
+  if (value != saved) {
+    std::cerr << "Warning: " << name << " " << saved
+              << " from the checkpoint replaces " << value << std::endl;
+    value = saved;
+  }
+}
+
+void Args::restore(const Args& saved) {
+  if (model != saved.model) {
+    std::cerr << "Warning: the checkpoint was trained with "
+              << modelName(saved.model) << ", not " << modelName(model)
+              << std::endl;
+    model = saved.model;
+  }
+  if (loss != saved.loss) {
+    std::cerr << "Warning: -loss " << lossName(saved.loss)
+              << " from the checkpoint replaces " << lossName(loss)
+              << std::endl;
+    loss = saved.loss;
+  }
+  restoreArg("-dim", dim, saved.dim);
+  restoreArg("-ws", ws, saved.ws);
+  restoreArg("-epoch", epoch, saved.epoch);
+  restoreArg("-minCount", minCount, saved.minCount);
+  restoreArg("-neg", neg, saved.neg);
+  restoreArg("-wordNgrams", wordNgrams, saved.wordNgrams);
+  restoreArg("-bucket", bucket, saved.bucket);
+  restoreArg("-minn", minn, saved.minn);
+  restoreArg("-maxn", maxn, saved.maxn);
+  restoreArg("-lrUpdateRate", lrUpdateRate, saved.lrUpdateRate);
+  restoreArg("-t", t, saved.t);
+}
+
 void Args::save(std::ostream& out) {
   out.write((char*) &(dim), sizeof(int));
   out.write((char*) &(ws), sizeof(int));
@@ -19,7 +19,7 @@
 namespace fasttext {
 
 enum class model_name : int {cbow=1, sg, sup};
-enum class loss_name : int {hs=1, ns, softmax};
+enum class loss_name : int {hs=1, ns, softmax, adaptive, sampled};
 
 class Args {
   public:
@@ -50,11 +50,33 @@ class Args {
     std::string label;
     int verbose;
     std::string pretrainedVectors;
+    int checkpointInterval;
+    std::string resume;
+    int validInterval;
+    int patience;
+    int numa;
+    int numaSync;
+    int hotRows;
+    int flushRate;
+    int sharedNegatives;
+    int ioThread;
+    int prefetch;
+    int hugePages;
+    int lazyBuckets;
+    int workers;
+    int rank;
+    std::string master;
+    int syncInterval;
+    int syncSparse;
+    int beam;
 
     void parseArgs(int, char**);
     void printHelp();
     void save(std::ostream&);
     void load(std::istream&);
+    // takes the settings saved with a checkpoint, warning about each one
+    // that replaces a different value given on the command line
+    void restore(const Args&);
 };
 
 }
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace fasttext {
+
+EmbeddingCache::EmbeddingCache(size_t capacity)
+  : capacity_(std::max<size_t>(capacity / NSHARDS, 1)),
+    hits_(0), misses_(0) {}
+
+// 64-bit FNV-1a
+uint64_t EmbeddingCache::hash(const std::string& text) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < text.size(); i++) {
+    h = (h ^ uint8_t(text[i])) * 1099511628211ULL;
+  }
+  return h;
+}
+
+bool EmbeddingCache::get(const std::string& text, Vector& vec,
+                         int32_t& count) {
+  uint64_t key = hash(text);
+  Shard& shard = shards_[key >> 60];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end() || it->second->text != text) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  const Entry& entry = *it->second;
+  memcpy(vec.data_, entry.vec.data(), entry.vec.size() * sizeof(real));
+  count = entry.count;
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void EmbeddingCache::put(const std::string& text, const Vector& vec,
+                         int32_t count) {
+  uint64_t key = hash(text);
+  Shard& shard = shards_[key >> 60];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  } else if (shard.index.size() >= capacity_) {
+    shard.index.erase(shard.lru.back().key);
+    shard.lru.splice(shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+    shard.index[key] = shard.lru.begin();
+  } else {
+    shard.lru.push_front(Entry());
+    shard.index[key] = shard.lru.begin();
+  }
+  Entry& entry = shard.lru.front();
+  entry.key = key;
+  entry.text = text;
+  entry.count = count;
+  entry.vec.assign(vec.data_, vec.data_ + vec.m_);
+}
+
+void EmbeddingCache::clear() {
+  for (int32_t i = 0; i < NSHARDS; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].index.clear();
+    shards_[i].lru.clear();
+  }
+  hits_.store(0);
+  misses_.store(0);
+}
+
+int64_t EmbeddingCache::hits() const {
+  return hits_.load(std::memory_order_relaxed);
+}
+
+int64_t EmbeddingCache::misses() const {
+  return misses_.load(std::memory_order_relaxed);
+}
+
+size_t EmbeddingCache::size() {
+  size_t total = 0;
+  for (int32_t i = 0; i < NSHARDS; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    total += shards_[i].index.size();
+  }
+  return total;
+}
+
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_CACHE_H
+#define FASTTEXT_CACHE_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+/**
+ * Vectors computed from a text, keyed by a hash of its content; entries keep
+ * the text, so colliding texts never return each other's vector. Entries are
+ * spread over shards with their own lock and LRU list, so lookups from
+ * several threads rarely contend; a full shard evicts its least recently
+ * used entry, reusing its storage. Every entry also keeps a count, e.g. the
+ * number of words the vector was averaged over.
+ */
+class EmbeddingCache {
+  private:
+    static const int32_t NSHARDS = 16;
+
+    struct Entry {
+      uint64_t key;
+      std::string text;
+      int32_t count;
+      std::vector<real> vec;
+    };
+    struct Shard {
+      std::mutex mutex;
+      std::list<Entry> lru;
+      std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    size_t capacity_;
+    Shard shards_[NSHARDS];
+    std::atomic<int64_t> hits_;
+    std::atomic<int64_t> misses_;
+
+  public:
+    explicit EmbeddingCache(size_t);
+
+    static uint64_t hash(const std::string&);
+
+    // copies the vector and count of text; false when it is not cached
+    bool get(const std::string&, Vector&, int32_t&);
+    void put(const std::string&, const Vector&, int32_t);
+    // drops every entry, e.g. when the model that computed them is replaced
+    void clear();
+
+    int64_t hits() const;
+    int64_t misses() const;
+    size_t size();
+};
+
+}
+
+#endif
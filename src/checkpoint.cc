@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace fasttext {
+
+static const int32_t CHECKPOINT_MAGIC = 0x46544350;
+
+TrainState::TrainState() {
+  epoch = 0;
+  tokenCount = 0;
+  bestLoss = std::numeric_limits<real>::max();
+}
+
+void TrainState::save(std::ostream& out) const {
+  int32_t n = positions.size();
+  out.write((char*) &CHECKPOINT_MAGIC, sizeof(int32_t));
+  out.write((char*) &epoch, sizeof(int32_t));
+  out.write((char*) &tokenCount, sizeof(int64_t));
+  out.write((char*) &bestLoss, sizeof(real));
+  out.write((char*) &n, sizeof(int32_t));
+  out.write((char*) positions.data(), n * sizeof(int64_t));
+}
+
+bool TrainState::load(std::istream& in) {
+  int32_t magic, n;
+  in.read((char*) &magic, sizeof(int32_t));
+  if (!in || magic != CHECKPOINT_MAGIC) {
+    return false;
+  }
+  in.read((char*) &epoch, sizeof(int32_t));
+  in.read((char*) &tokenCount, sizeof(int64_t));
+  in.read((char*) &bestLoss, sizeof(real));
+  in.read((char*) &n, sizeof(int32_t));
+  positions.resize(n);
+  in.read((char*) positions.data(), n * sizeof(int64_t));
+  return !in.fail();
+}
+
+FilePositions::FilePositions() : size_(0) {}
+
+void FilePositions::reset(int32_t threads,
+                          const std::vector<int64_t>& positions) {
+  if (threads != size_) {
+    size_ = threads;
+    positions_.reset(new std::atomic<int64_t>[threads]);
+  }
+  bool known = positions.size() == size_t(threads);
+  for (int32_t i = 0; i < size_; i++) {
+    set(i, known ? positions[i] : -1);
+  }
+}
+
+int64_t FilePositions::get(int32_t thread) const {
+  return positions_[thread].load(std::memory_order_relaxed);
+}
+
+void FilePositions::set(int32_t thread, int64_t position) {
+  positions_[thread].store(position, std::memory_order_relaxed);
+}
+
+void FilePositions::track(int32_t thread, std::istream& in) {
+  int64_t position = in.tellg();
+  if (position >= 0) {
+    set(thread, position);
+  }
+}
+
+std::vector<int64_t> FilePositions::snapshot() const {
+  std::vector<int64_t> positions(size_);
+  for (int32_t i = 0; i < size_; i++) {
+    positions[i] = get(i);
+  }
+  return positions;
+}
+
+Checkpointer::Checkpointer(const Matrices& sources, int32_t interval)
+  : sources_(sources), busy_(false), interval_(interval),
+    last_(std::chrono::steady_clock::now()) {
+  for (auto it = sources_.cbegin(); it != sources_.cend(); ++it) {
+    staging_.push_back(std::make_shared<Matrix>((*it)->m_, (*it)->n_));
+  }
+}
+
+Checkpointer::~Checkpointer() {
+  wait();
+}
+
+bool Checkpointer::due() const {
+  if (interval_.count() <= 0 || busy_) {
+    return false;
+  }
+  return std::chrono::steady_clock::now() - last_ >= interval_;
+}
+
+void Checkpointer::snapshot() {
+  wait();
+  for (size_t i = 0; i < sources_.size(); i++) {
+    sources_[i]->copyTo(*staging_[i]);
+  }
+  last_ = std::chrono::steady_clock::now();
+}
+
+const Checkpointer::Matrices& Checkpointer::staged() const {
+  return staging_;
+}
+
+void Checkpointer::write(const Jobs& jobs) {
+  wait();
+  busy_ = true;
+  writer_ = std::thread([this, jobs]() {
+    for (auto it = jobs.cbegin(); it != jobs.cend(); ++it) {
+      std::string tmp = it->first + ".tmp";
+      std::ofstream ofs(tmp, std::ofstream::binary);
+      if (!ofs.is_open()) {
+        std::cerr << "Checkpoint file " << tmp << " cannot be opened!"
+                  << std::endl;
+        continue;
+      }
+      it->second(ofs, staging_);
+      ofs.close();
+      if (rename(tmp.c_str(), it->first.c_str()) != 0) {
+        std::cerr << "Checkpoint file " << it->first << " cannot be written!"
+                  << std::endl;
+      }
+    }
+    busy_ = false;
+  });
+}
+
+bool Checkpointer::save(const Jobs& jobs, bool blocking) {
+  if (busy_ && !blocking) {
+    return false;
+  }
+  snapshot();
+  write(jobs);
+  return true;
+}
+
+void Checkpointer::wait() {
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+}
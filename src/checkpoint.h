@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_CHECKPOINT_H
+#define FASTTEXT_CHECKPOINT_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+/**
+ * Training progress stored at the end of a checkpoint file, after the
+ * regular model sections, so that a checkpoint can also be loaded as a model.
+ */
+struct TrainState {
+  int32_t epoch;
+  int64_t tokenCount;
+  real bestLoss;
+  // per-thread input file offsets, -1 when unknown
+  std::vector<int64_t> positions;
+
+  TrainState();
+  void save(std::ostream&) const;
+  bool load(std::istream&);
+};
+
+/**
+ * Per-thread input file offsets, -1 for the start of the thread's slice.
+ * Trainers publish their own offset while thread 0 copies all of them into
+ * a checkpoint, so each one is an atomic.
+ */
+class FilePositions {
+  public:
+    FilePositions();
+
+    // the offsets of a checkpoint, or -1 for every thread when there are
+    // none for this number of threads
+    void reset(int32_t threads,
+               const std::vector<int64_t>& = std::vector<int64_t>());
+    int64_t get(int32_t) const;
+    void set(int32_t, int64_t);
+    // the offset of the stream, unless tellg fails
+    void track(int32_t, std::istream&);
+    std::vector<int64_t> snapshot() const;
+
+  private:
+    int32_t size_;
+    std::unique_ptr<std::atomic<int64_t>[]> positions_;
+};
+
+/**
+ * Copies a fixed set of matrices into staging buffers and writes them from a
+ * background thread, so Hogwild workers can keep updating the originals.
+ */
+class Checkpointer {
+  public:
+    typedef std::vector<std::shared_ptr<Matrix>> Matrices;
+    typedef std::function<void(std::ostream&, const Matrices&)> Writer;
+    typedef std::vector<std::pair<std::string, Writer>> Jobs;
+
+    Checkpointer(const Matrices&, int32_t interval);
+    ~Checkpointer();
+
+    bool due() const;
+    void snapshot();
+    const Matrices& staged() const;
+    void write(const Jobs&);
+    bool save(const Jobs&, bool blocking = false);
+    void wait();
+
+  private:
+    Matrices sources_;
+    Matrices staging_;
+    std::thread writer_;
+    std::atomic<bool> busy_;
+    std::chrono::seconds interval_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+}
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "cluster.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include "utils.h"
+
+namespace fasttext {
+
+RowTracker::RowTracker(int64_t size)
+  : size_(size), dirty_(new std::atomic<uint8_t>[size]) {
+  for (int64_t i = 0; i < size_; i++) {
+    dirty_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+std::vector<int64_t> RowTracker::collect() {
+  std::vector<int64_t> rows;
+  for (int64_t i = 0; i < size_; i++) {
+    if (dirty_[i].load(std::memory_order_relaxed)) {
+      dirty_[i].store(0, std::memory_order_relaxed);
+      rows.push_back(i);
+    }
+  }
+  return rows;
+}
+
+static void fail(const std::string& what) {
+  std::cerr << "Cluster: " << what << ": " << strerror(errno) << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+static void writeAll(int fd, const void* data, size_t size) {
+  const char* p = (const char*) data;
+  while (size > 0) {
+    ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+    if (n <= 0) {
+      fail("lost connection");
+    }
+    p += n;
+    size -= n;
+  }
+}
+
+static void readAll(int fd, void* data, size_t size) {
+  char* p = (char*) data;
+  while (size > 0) {
+    ssize_t n = ::recv(fd, p, size, 0);
+    if (n <= 0) {
+      fail("lost connection");
+    }
+    p += n;
+    size -= n;
+  }
+}
+
+Cluster::Cluster(std::shared_ptr<Args> args, const Matrices& matrices,
+                 const std::vector<bool>& tracked)
+  : args_(args), matrices_(matrices) {
+  if (args_->rank < 0 || args_->rank >= args_->workers) {
+    std::cerr << "Cluster: -rank should be in [0, -workers)" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    bool sparse = args_->syncSparse && tracked[i];
+    trackers_.push_back(
+        sparse ? std::make_shared<RowTracker>(matrices_[i]->m_) : nullptr);
+  }
+  if (args_->rank == 0) {
+    listen();
+  } else {
+    connect();
+  }
+}
+
+Cluster::~Cluster() {
+  for (auto it = peers_.cbegin(); it != peers_.cend(); ++it) {
+    if (*it >= 0) {
+      close(*it);
+    }
+  }
+}
+
+int32_t Cluster::rank() const {
+  return args_->rank;
+}
+
+int32_t Cluster::size() const {
+  return args_->workers;
+}
+
+std::shared_ptr<RowTracker> Cluster::tracker(size_t i) const {
+  return trackers_[i];
+}
+
+void Cluster::listen() {
+  int server = utils::openSocket(args_->master, true);
+  if (::listen(server, args_->workers) != 0) {
+    fail("listen");
+  }
+  peers_.assign(args_->workers - 1, -1);
+  idle_.assign(args_->workers - 1, false);
+  for (int32_t i = 1; i < args_->workers; i++) {
+    int fd = accept(server, nullptr, nullptr);
+    if (fd < 0) {
+      fail("accept");
+    }
+    int32_t rank;
+    readAll(fd, &rank, sizeof(rank));
+    bool same = rank > 0 && rank < args_->workers && peers_[rank - 1] < 0;
+    for (auto it = matrices_.cbegin(); it != matrices_.cend(); ++it) {
+      int64_t shape[2];
+      readAll(fd, shape, sizeof(shape));
+      same = same && shape[0] == (*it)->m_ && shape[1] == (*it)->n_;
+    }
+    if (!same) {
+      std::cerr << "Cluster: rank " << rank << " has another model shape"
+                << " or was started twice" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    peers_[rank - 1] = fd;
+  }
+  close(server);
+}
+
+void Cluster::connect() {
+  // rank 0 may still be reading the input
+  int fd = -1;
+  for (int32_t attempt = 0; fd < 0; attempt++) {
+    fd = utils::openSocket(args_->master, false);
+    if (fd < 0) {
+      if (attempt >= 600) {
+        fail("cannot connect to " + args_->master);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  int32_t rank = args_->rank;
+  writeAll(fd, &rank, sizeof(rank));
+  for (auto it = matrices_.cbegin(); it != matrices_.cend(); ++it) {
+    int64_t shape[2] = {(*it)->m_, (*it)->n_};
+    writeAll(fd, shape, sizeof(shape));
+  }
+  peers_.assign(1, fd);
+}
+
+std::vector<int64_t> Cluster::rows(size_t i) {
+  if (trackers_[i]) {
+    return trackers_[i]->collect();
+  }
+  std::vector<int64_t> all(matrices_[i]->m_);
+  for (int64_t r = 0; r < matrices_[i]->m_; r++) {
+    all[r] = r;
+  }
+  return all;
+}
+
+// done flag, then for every matrix: row count, row ids and row values
+void Cluster::send(int fd, bool done,
+                   const std::vector<std::vector<int64_t>>& ids) {
+  int32_t flag = done;
+  writeAll(fd, &flag, sizeof(flag));
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    const Matrix& matrix = *matrices_[i];
+    int64_t count = ids[i].size();
+    writeAll(fd, &count, sizeof(count));
+    writeAll(fd, ids[i].data(), count * sizeof(int64_t));
+    for (auto it = ids[i].cbegin(); it != ids[i].cend(); ++it) {
+      matrix.touchRow(*it);
+      writeAll(fd, matrix.data_ + *it * matrix.n_, matrix.n_ * sizeof(real));
+    }
+  }
+}
+
+bool Cluster::receive(int fd, std::vector<std::vector<int64_t>>& ids,
+                      std::vector<std::vector<real>>& values) {
+  int32_t flag;
+  readAll(fd, &flag, sizeof(flag));
+  ids.resize(matrices_.size());
+  values.resize(matrices_.size());
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    int64_t count;
+    readAll(fd, &count, sizeof(count));
+    ids[i].resize(count);
+    values[i].resize(count * matrices_[i]->n_);
+    readAll(fd, ids[i].data(), count * sizeof(int64_t));
+    readAll(fd, values[i].data(), values[i].size() * sizeof(real));
+  }
+  return flag != 0;
+}
+
+void Cluster::apply(const std::vector<std::vector<int64_t>>& ids,
+                    const std::vector<std::vector<real>>& values) {
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    Matrix& matrix = *matrices_[i];
+    for (size_t r = 0; r < ids[i].size(); r++) {
+      // a lazy row must not be initialized over the merged values later
+      matrix.touchRow(ids[i][r]);
+      memcpy(matrix.data_ + ids[i][r] * matrix.n_,
+             values[i].data() + r * matrix.n_, matrix.n_ * sizeof(real));
+    }
+  }
+}
+
+bool Cluster::sync(bool done) {
+  std::vector<std::vector<int64_t>> ids(matrices_.size());
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    ids[i] = rows(i);
+  }
+  std::vector<std::vector<real>> values;
+
+  if (args_->rank != 0) {
+    send(peers_[0], done, ids);
+    receive(peers_[0], ids, values);
+    apply(ids, values);
+    return !done;
+  }
+
+  // sums and counts of every row sent in this round, own rows included
+  std::vector<std::unordered_map<int64_t, size_t>> slots(matrices_.size());
+  std::vector<std::vector<int64_t>> merged(matrices_.size());
+  std::vector<std::vector<real>> sums(matrices_.size());
+  std::vector<std::vector<int32_t>> counts(matrices_.size());
+  auto add = [&](size_t i, int64_t row, const real* value) {
+    int64_t n = matrices_[i]->n_;
+    auto slot = slots[i].emplace(row, merged[i].size());
+    if (slot.second) {
+      merged[i].push_back(row);
+      sums[i].resize(sums[i].size() + n, 0.0);
+      counts[i].push_back(0);
+    }
+    real* sum = sums[i].data() + slot.first->second * n;
+    for (int64_t j = 0; j < n; j++) {
+      sum[j] += value[j];
+    }
+    counts[i][slot.first->second]++;
+  };
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    for (auto it = ids[i].cbegin(); it != ids[i].cend(); ++it) {
+      matrices_[i]->touchRow(*it);
+      add(i, *it, matrices_[i]->data_ + *it * matrices_[i]->n_);
+    }
+  }
+  std::vector<bool> active(peers_.size(), false);
+  for (size_t p = 0; p < peers_.size(); p++) {
+    if (idle_[p]) continue;
+    active[p] = true;
+    idle_[p] = receive(peers_[p], ids, values);
+    for (size_t i = 0; i < matrices_.size(); i++) {
+      int64_t n = matrices_[i]->n_;
+      for (size_t r = 0; r < ids[i].size(); r++) {
+        add(i, ids[i][r], values[i].data() + r * n);
+      }
+    }
+  }
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    int64_t n = matrices_[i]->n_;
+    for (size_t r = 0; r < merged[i].size(); r++) {
+      for (int64_t j = 0; j < n; j++) {
+        sums[i][r * n + j] /= counts[i][r];
+      }
+    }
+  }
+  apply(merged, sums);
+
+  bool waiting = !done;
+  for (size_t p = 0; p < peers_.size(); p++) {
+    if (active[p]) {
+      send(peers_[p], false, merged);
+    }
+    waiting = waiting || !idle_[p];
+  }
+  if (!waiting) {
+    idle_.assign(peers_.size(), false);
+  }
+  return waiting;
+}
+
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_CLUSTER_H
+#define FASTTEXT_CLUSTER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+/**
+ * Rows of a matrix written since the last merge. Trainers mark rows with
+ * relaxed stores, so marking costs about as much as the write itself.
+ */
+class RowTracker {
+  private:
+    int64_t size_;
+    std::unique_ptr<std::atomic<uint8_t>[]> dirty_;
+
+  public:
+    explicit RowTracker(int64_t);
+
+    inline void mark(int64_t i) {
+      if (!dirty_[i].load(std::memory_order_relaxed)) {
+        dirty_[i].store(1, std::memory_order_relaxed);
+      }
+    }
+
+    // dirty rows in order, clearing them
+    std::vector<int64_t> collect();
+};
+
+/**
+ * Processes training the same model on their own shards of the input. Rank
+ * 0 listens on -master, the others connect to it. In every round each
+ * process sends its rows to rank 0, which averages them and sends the
+ * result back. With -syncSparse only the rows written since the previous
+ * round are sent for the tracked matrices, and a row is averaged over the
+ * processes that wrote it; other matrices are always sent whole. Rounds go
+ * on until every process has called sync with done, e.g. at the end of an
+ * epoch, after which the next call starts a new phase.
+ */
+class Cluster {
+  public:
+    typedef std::vector<std::shared_ptr<Matrix>> Matrices;
+
+    Cluster(std::shared_ptr<Args>, const Matrices&, const std::vector<bool>&);
+    ~Cluster();
+
+    int32_t rank() const;
+    int32_t size() const;
+    // tracker of the i-th matrix, nullptr when whole matrices are merged
+    std::shared_ptr<RowTracker> tracker(size_t) const;
+    // one merge round; returns false once every process is done
+    bool sync(bool done);
+
+  private:
+    std::shared_ptr<Args> args_;
+    Matrices matrices_;
+    std::vector<std::shared_ptr<RowTracker>> trackers_;
+    // rank 0: one socket per other rank, other ranks: the socket to rank 0
+    std::vector<int> peers_;
+    // rank 0: the ranks done in the current phase
+    std::vector<bool> idle_;
+
+    void listen();
+    void connect();
+    std::vector<int64_t> rows(size_t);
+    void send(int, bool, const std::vector<std::vector<int64_t>>&);
+    bool receive(int, std::vector<std::vector<int64_t>>&,
+                 std::vector<std::vector<real>>&);
+    void apply(const std::vector<std::vector<int64_t>>&,
+               const std::vector<std::vector<real>>&);
+};
+
+}
+
+#endif
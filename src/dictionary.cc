@@ -169,13 +169,18 @@ void Dictionary::initNgrams() {
   }
 }
 
+static inline bool isSeparator(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+         c == '\f' || c == '\0';
+}
+
 bool Dictionary::readWord(std::istream& in, std::string& word) const
 {
   char c;
   std::streambuf& sb = *in.rdbuf();
   word.clear();
   while ((c = sb.sbumpc()) != EOF) {
-    if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f' || c == '\0') {
+    if (isSeparator(c)) {
       if (word.empty()) {
         if (c == '\n') {
           word += EOS;
@@ -195,6 +200,30 @@ bool Dictionary::readWord(std::istream& in, std::string& word) const
   return !word.empty();
 }
 
+// readWord over line[pos, end), advancing pos
+bool Dictionary::readWord(const std::string& line, size_t& pos, size_t end,
+                          std::string& word) const {
+  word.clear();
+  while (pos < end) {
+    char c = line[pos++];
+    if (isSeparator(c)) {
+      if (word.empty()) {
+        if (c == '\n') {
+          word += EOS;
+          return true;
+        }
+        continue;
+      }
+      if (c == '\n') {
+        pos--;
+      }
+      return true;
+    }
+    word.push_back(c);
+  }
+  return !word.empty();
+}
+
 void Dictionary::readFromFile(std::istream& in, int index, int batch) {
   std::string word;
   int64_t minThreshold = 1;
@@ -271,9 +300,10 @@ std::vector<int64_t> Dictionary::getCounts(entry_type type) const {
   return counts;
 }
 
-void Dictionary::addNgrams(std::vector<int32_t>& line, int32_t n) const {
+void Dictionary::addNgrams(std::vector<int32_t>& line, int32_t n,
+                           size_t begin) const {
   int32_t line_size = line.size();
-  for (int32_t i = 0; i < line_size; i++) {
+  for (int32_t i = begin; i < line_size; i++) {
     uint64_t h = line[i];
     for (int32_t j = i + 1; j < line_size && j < i + n; j++) {
       h = h * 116049371 + line[j];
@@ -285,7 +315,8 @@ void Dictionary::addNgrams(std::vector<int32_t>& line, int32_t n) const {
 int32_t Dictionary::getLine(std::istream& in,
                             std::vector<int32_t>& words,
                             std::vector<int32_t>& labels,
-                            std::minstd_rand& rng) const {
+                            std::minstd_rand& rng,
+                            bool subsample) const {
   std::uniform_real_distribution<> uniform(0, 1);
   std::string token;
   int32_t ntokens = 0;
@@ -301,7 +332,9 @@ int32_t Dictionary::getLine(std::istream& in,
     if (wid < 0) continue;
     entry_type type = getType(wid);
     ntokens++;
-    if (type == entry_type::word) {
+    // discarded words still count toward training progress
+    if (type == entry_type::word &&
+        !(subsample && discard(wid, uniform(rng)))) {
       words.push_back(wid);
     }
     if (type == entry_type::label) {
@@ -388,7 +421,86 @@ int32_t Dictionary::getWords(const std::string &line,
   return ntokens;
 }
 
-std::string Dictionary::getLabel(int32_t lid) const {
+int32_t Dictionary::getLine(const std::string& line,
+                            std::vector<int32_t>& words,
+                            std::vector<int32_t>& labels,
+                            std::string& token) const {
+  int32_t ntokens = 0;
+  size_t pos = 0;
+  words.clear();
+  labels.clear();
+  while (readWord(line, pos, line.size(), token)) {
+    if (token == EOS) break;
+    int32_t wid = getId(token);
+    if (wid < 0) continue;
+    entry_type type = getType(wid);
+    ntokens++;
+    if (type == entry_type::word) {
+      words.push_back(wid);
+    }
+    if (type == entry_type::label) {
+      labels.push_back(wid - nwords_);
+    }
+    if (words.size() > MAX_LINE_SIZE && args_->model != model_name::sup) break;
+  }
+  return ntokens;
+}
+
+// like utils::split, the text before the first tab is skipped and every
+// other field is read up to its first newline
+int32_t Dictionary::getWords(const std::string& line,
+                             std::vector<int32_t>& words,
+                             int ngram,
+                             std::string& token) const {
+  int32_t ntokens = 0;
+  words.clear();
+  for (size_t begin = line.find('\t'); begin < line.size();) {
+    size_t end = std::min(line.find('\t', begin + 1), line.size());
+    size_t pos = begin + 1, first = words.size();
+    while (readWord(line, pos, end, token)) {
+      if (token == EOS) break;
+      int32_t wid = getId(token);
+      if (wid < 0) continue;
+      ntokens++;
+      if (getType(wid) == entry_type::word) {
+        words.push_back(wid);
+      }
+      if (words.size() - first > MAX_LINE_SIZE &&
+          args_->model != model_name::sup) break;
+    }
+    addNgrams(words, ngram, first);
+    begin = end;
+  }
+  return ntokens;
+}
+
+int32_t Dictionary::getWords(const std::string& line,
+                             std::vector<std::pair<int32_t, real>>& words,
+                             std::minstd_rand& rng,
+                             std::string& token) const {
+  std::uniform_real_distribution<> uniform(0, 1);
+  int32_t ntokens = 0;
+  words.clear();
+  for (size_t begin = line.find('\t'); begin < line.size();) {
+    size_t end = std::min(line.find('\t', begin + 1), line.size());
+    size_t pos = begin + 1, first = words.size();
+    while (readWord(line, pos, end, token)) {
+      if (token == EOS) break;
+      int32_t wid = getId(token);
+      if (wid < 0) continue;
+      ntokens++;
+      if (getType(wid) == entry_type::word && !discard(wid, uniform(rng))) {
+        words.push_back(std::make_pair(wid, getTF(wid)));
+      }
+      if (words.size() - first > MAX_LINE_SIZE &&
+          args_->model != model_name::sup) break;
+    }
+    begin = end;
+  }
+  return ntokens;
+}
+
+const std::string& Dictionary::getLabel(int32_t lid) const {
   assert(lid >= 0);
   assert(lid < nlabels_);
   return words_[lid + nwords_].word;
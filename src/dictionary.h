@@ -72,23 +72,33 @@ class Dictionary {
     uint32_t hash(const std::string& str) const;
     void add(const std::string&);
     bool readWord(std::istream&, std::string&) const;
+    bool readWord(const std::string&, size_t&, size_t, std::string&) const;
     void readFromFile(std::istream&, int index, int batch);
     void addWords(std::string&);
-    std::string getLabel(int32_t) const;
+    const std::string& getLabel(int32_t) const;
     void save(std::ostream&) const;
     void load(std::istream&);
     void build(std::istream&);
 
     std::vector<int64_t> getCounts(entry_type) const;
-    void addNgrams(std::vector<int32_t>&, int32_t) const;
+    void addNgrams(std::vector<int32_t>&, int32_t, size_t begin = 0) const;
     int32_t getLine(std::istream&, std::vector<int32_t>&,
-                    std::vector<int32_t>&, std::minstd_rand&) const;
+                    std::vector<int32_t>&, std::minstd_rand&,
+                    bool subsample = false) const;
     int32_t getLine(const std::string&, std::vector<int32_t>&, std::minstd_rand&) const;
     int32_t getLine(const std::string&, std::vector<std::pair<int32_t, real>>&, std::minstd_rand&) const;
 
     int32_t getWords(const std::string&, std::vector<int32_t>&, int, std::minstd_rand&) const;
 
     int32_t getWords(const std::string&, std::vector<std::pair<int32_t, real>>&, int, std::minstd_rand&) const;
+
+    // the same without temporaries, reading words into the given buffer
+    int32_t getLine(const std::string&, std::vector<int32_t>&,
+                    std::vector<int32_t>&, std::string&) const;
+    int32_t getWords(const std::string&, std::vector<int32_t>&, int,
+                     std::string&) const;
+    int32_t getWords(const std::string&, std::vector<std::pair<int32_t, real>>&,
+                     std::minstd_rand&, std::string&) const;
     void threshold(int64_t, int64_t);
 
     void printWord();
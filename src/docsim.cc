@@ -3,6 +3,8 @@
 //
 #include "docsim.h"
 
+#include <string.h>
+
 #include <iostream>
 
 namespace fasttext {
@@ -10,20 +12,85 @@ namespace fasttext {
 void DocSim::loadModel(const std::string &path) {
   std::cout << path << std::endl;
   fastText_.loadModel(path);
+  clearCache();
+  setThreads(pool_ ? pool_->size() : 1);
 }
 
+int32_t DocSim::getDimension() const {
+  return fastText_.getDim();
+}
 
-real DocSim::predictProbability(const std::string &first, const std::string &second) const {
-  Vector firstVector(512);
-  Vector secondVector(512);
+void DocSim::setThreads(int32_t threads) {
+  pool_ = std::make_shared<ThreadPool>(threads);
+  sessions_.clear();
+  for (int32_t i = 0; i < pool_->size(); i++) {
+    sessions_.push_back(createSession(i));
+  }
+}
+
+void DocSim::predictProbabilities(const char *const *first, const size_t *firstSize,
+                                  const char *const *second, const size_t *secondSize,
+                                  size_t n, real *out) {
+  pool_->parallelFor(n, [&](size_t i, int32_t worker) {
+    InferenceSession &session = *sessions_[worker];
+    session.firstText.assign(first[i], firstSize[i]);
+    session.secondText.assign(second[i], secondSize[i]);
+    out[i] = predictProbability(session, session.firstText, session.secondText);
+  });
+}
+
+void DocSim::getVectors(const char *const *texts, const size_t *sizes,
+                        size_t n, real *out) {
+  int32_t dim = getDimension();
+  pool_->parallelFor(n, [&](size_t i, int32_t worker) {
+    InferenceSession &session = *sessions_[worker];
+    session.firstText.assign(texts[i], sizes[i]);
+    getVector(session, session.firstOutput, session.firstText);
+    memcpy(out + i * dim, session.firstOutput.data_, dim * sizeof(real));
+  });
+}
+
+void DocSim::setCacheSize(size_t entries) {
+  cache_ = entries > 0 ? std::make_shared<EmbeddingCache>(entries) : nullptr;
+}
 
-  fastText_.getVector(firstVector, first);
-  fastText_.getVector(secondVector, second);
+void DocSim::clearCache() {
+  if (cache_) {
+    cache_->clear();
+  }
+}
+
+std::shared_ptr<EmbeddingCache> DocSim::cache() const {
+  return cache_;
+}
+
+void DocSim::getVector(InferenceSession &session, Vector &vec,
+                       const std::string &text) const {
+  int32_t count;
+  if (cache_ && cache_->get(text, vec, count)) {
+    return;
+  }
+  fastText_.getVector(session, vec, text);
+  if (cache_) {
+    cache_->put(text, vec, 0);
+  }
+}
 
-  std::cout << firstVector << std::endl;
-  std::cout << secondVector << std::endl;
 
-  return cosine(firstVector, secondVector);
+real DocSim::predictProbability(const std::string &first, const std::string &second) const {
+  return predictProbability(*createSession(), first, second);
+}
+
+std::shared_ptr<InferenceSession> DocSim::createSession(int32_t seed) const {
+  return fastText_.createSession(seed);
+}
+
+real DocSim::predictProbability(InferenceSession &session,
+                                const std::string &first,
+                                const std::string &second) const {
+  getVector(session, session.firstOutput, first);
+  getVector(session, session.secondOutput, second);
+  return cosine(session.firstOutput, session.secondOutput);
 }
 
 real DocSim::firstSimilarity(const std::string &first, const std::string &second) const {
@@ -5,18 +5,52 @@
 #ifndef FASTTEXT_DOCSIM_H
 #define FASTTEXT_DOCSIM_H
 
+#include "cache.h"
 #include "fasttext.h"
+#include "pool.h"
 
 namespace fasttext {
 class DocSim {
 private:
   FastText fastText_;
+  // text to document vector, nullptr when caching is off
+  std::shared_ptr<EmbeddingCache> cache_;
+  // batch calls run on pool_ with one session per worker
+  std::shared_ptr<ThreadPool> pool_;
+  std::vector<std::shared_ptr<InferenceSession>> sessions_;
+
+  void getVector(InferenceSession &, Vector &, const std::string &) const;
 
 public:
   void loadModel(const std::string &);
 
   real predictProbability(const std::string &first, const std::string &second) const;
 
+  // one session per thread makes concurrent calls safe
+  std::shared_ptr<InferenceSession> createSession(int32_t seed = 0) const;
+
+  real predictProbability(InferenceSession &, const std::string &first, const std::string &second) const;
+
+  // caches the vectors of up to entries texts, 0 turns caching off
+  void setCacheSize(size_t entries);
+
+  void clearCache();
+
+  std::shared_ptr<EmbeddingCache> cache() const;
+
+  int32_t getDimension() const;
+
+  // workers of the batch calls, 1 runs them on the calling thread
+  void setThreads(int32_t);
+
+  // out[i] is the score of first[i] and second[i], texts given by pointer and size
+  void predictProbabilities(const char *const *first, const size_t *firstSize,
+                            const char *const *second, const size_t *secondSize,
+                            size_t n, real *out);
+
+  // out holds n rows of getDimension() values
+  void getVectors(const char *const *texts, const size_t *sizes, size_t n, real *out);
+
   real firstSimilarity(const std::string &, const std::string &) const;
 
   real secondSimilarity(const std::string &, const std::string &) const;
@@ -11,7 +11,9 @@
 
 #include <fenv.h>
 #include <math.h>
+#include <stdio.h>
 
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <thread>
@@ -19,6 +21,8 @@
 #include <vector>
 #include <algorithm>
 
+#include "pipeline.h"
+
 namespace fasttext {
 
 void FastText::getVector(Vector& vec, const std::string& line) const {
@@ -37,6 +41,18 @@ void FastText::getVector(Vector& vec, const std::string& line) const {
   }
 }
 
+void FastText::getVector(InferenceSession& session, Vector& vec,
+                         const std::string& line) const {
+  dict_->getWords(line, session.words, args_->wordNgrams, session.token);
+  vec.zero();
+  for (auto it = session.words.cbegin(); it != session.words.cend(); ++it) {
+    vec.addRow(*input_, *it);
+  }
+  if (session.words.size() > 0) {
+    vec.mul(1.0 / session.words.size());
+  }
+}
+
 void FastText::saveVectors() {
   std::ofstream ofs(args_->output + ".vec");
   if (!ofs.is_open()) {
@@ -96,9 +112,50 @@ void FastText::loadModel(std::istream& in) {
   }
 }
 
+void FastText::saveCheckpoint() {
+  TrainState state;
+  state.tokenCount = tokenCount_->total();
+  state.positions = positions_.snapshot();
+  std::shared_ptr<Args> args = args_;
+  std::shared_ptr<Dictionary> dict = dict_;
+  checkpointer_->save({{args_->output + ".ckpt",
+      [args, dict, state](std::ostream& out,
+                          const Checkpointer::Matrices& m) {
+        args->save(out);
+        dict->save(out);
+        m[0]->save(out);
+        m[1]->save(out);
+        state.save(out);
+      }}});
+}
+
+void FastText::loadCheckpoint(const std::string& filename, TrainState& state) {
+  std::ifstream ifs(filename, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    std::cerr << "Checkpoint file cannot be opened for resuming!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  input_ = std::make_shared<Matrix>();
+  output_ = std::make_shared<Matrix>();
+  Args saved;
+  saved.load(ifs);
+  args_->restore(saved);
+  dict_->load(ifs);
+  input_->load(ifs);
+  output_->load(ifs);
+  if (!state.load(ifs)) {
+    std::cerr << "Checkpoint file has no training state!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  ifs.close();
+  if (args_->verbose > 0) {
+    std::cout << "Resuming from " << state.tokenCount << " tokens" << std::endl;
+  }
+}
+
 void FastText::printInfo(real progress, real loss) {
   real t = real(clock() - start) / CLOCKS_PER_SEC;
-  real wst = real(tokenCount) / t;
+  real wst = real(tokenCount_->total()) / t;
   real lr = args_->lr * (1.0 - progress);
   int eta = int(t / progress * (1 - progress) / args_->thread);
   int etah = eta / 3600;
@@ -121,100 +178,336 @@ void FastText::supervised(Model& model, real lr,
   model.update(line, labels[i], lr);
 }
 
+// pairs of equal rows between two sorted lists of rows
+static int32_t sharedRows(const std::vector<int32_t>& a,
+                          const std::vector<int32_t>& b) {
+  int32_t shared = 0;
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      int32_t row = a[i], na = 0, nb = 0;
+      for (; i < a.size() && a[i] == row; i++) na++;
+      for (; j < b.size() && b[j] == row; j++) nb++;
+      shared += na * nb;
+    }
+  }
+  return shared;
+}
+
+// Keeps the sum of the subword rows of every word within ws of the center,
+// so that moving the window reads the rows of one word instead of all of them.
+// An update adds the gradient to every row of the context words, so each sum
+// takes it once per row it shares with them: repeated words, common char
+// n-grams and colliding buckets alike. These counts are computed when a word
+// enters the window. Writes by other threads to these rows are only seen when
+// a word enters the window again, at most one line later.
 void FastText::cbow(Model& model, real lr,
                     const std::vector<int32_t>& line) {
+  const int32_t ws = args_->ws, span = 2 * ws + 1;
+  const int32_t n = line.size();
+  std::vector<std::shared_ptr<Vector>> sums;
+  std::vector<int32_t> counts(span, 0);
+  // sorted rows of each slot, and the rows shared by slots a and b at
+  // a * span + b
+  std::vector<std::vector<int32_t>> rows(span);
+  std::vector<int32_t> shared(span * span, 0);
+  for (int32_t i = 0; i < span; i++) {
+    sums.push_back(std::make_shared<Vector>(args_->dim));
+  }
+  Vector window(args_->dim), hidden(args_->dim);
+  window.zero();
+  int64_t total = 0;
+  auto enter = [&](int32_t i) {
+    const std::vector<int32_t>& ngrams = dict_->getNgrams(line[i]);
+    int32_t slot = i % span;
+    model.computeHidden(ngrams, *sums[slot]);
+    sums[slot]->mul(ngrams.size());
+    counts[slot] = ngrams.size();
+    window.addVec(*sums[slot]);
+    total += counts[slot];
+    rows[slot].assign(ngrams.cbegin(), ngrams.cend());
+    std::sort(rows[slot].begin(), rows[slot].end());
+    for (int32_t j = std::max(i - span + 1, 0); j <= i; j++) {
+      int32_t other = j % span;
+      shared[slot * span + other] = shared[other * span + slot] =
+          sharedRows(rows[slot], rows[other]);
+    }
+  };
+  auto leave = [&](int32_t i) {
+    int32_t slot = i % span;
+    window.addVec(*sums[slot], -1.0);
+    total -= counts[slot];
+  };
+
   std::vector<int32_t> bow;
-  std::uniform_int_distribution<> uniform(1, args_->ws);
-  for (int32_t w = 0; w < line.size(); w++) {
+  std::uniform_int_distribution<> uniform(1, ws);
+  for (int32_t i = 0; i < std::min(ws, n); i++) {
+    enter(i);
+  }
+  for (int32_t w = 0; w < n; w++) {
     int32_t boundary = uniform(model.rng);
+    if (w - ws - 1 >= 0) {
+      leave(w - ws - 1);
+    }
+    if (w + ws < n) {
+      enter(w + ws);
+    }
+    hidden.zero();
+    hidden.addVec(window);
+    int64_t count = total;
+    for (int32_t c = -ws; c <= ws; c++) {
+      bool inside = c != 0 && c >= -boundary && c <= boundary;
+      if (!inside && w + c >= 0 && w + c < n) {
+        hidden.addVec(*sums[(w + c) % span], -1.0);
+        count -= counts[(w + c) % span];
+      }
+    }
+    if (count == 0) continue;
+    hidden.mul(1.0 / count);
+
     bow.clear();
     for (int32_t c = -boundary; c <= boundary; c++) {
-      if (c != 0 && w + c >= 0 && w + c < line.size()) {
+      if (c != 0 && w + c >= 0 && w + c < n) {
         const std::vector<int32_t>& ngrams = dict_->getNgrams(line[w + c]);
         bow.insert(bow.end(), ngrams.cbegin(), ngrams.cend());
       }
     }
-    model.update(bow, line[w], lr);
+    model.update(bow, hidden, line[w], lr);
+
+    const Vector& grad = model.getGrad();
+    int64_t updated = 0;
+    for (int32_t i = std::max(w - ws, 0); i <= std::min(w + ws, n - 1); i++) {
+      int32_t slot = i % span;
+      int64_t hits = 0;
+      for (int32_t c = -boundary; c <= boundary; c++) {
+        if (c != 0 && w + c >= 0 && w + c < n) {
+          hits += shared[slot * span + (w + c) % span];
+        }
+      }
+      if (hits > 0) {
+        sums[slot]->addVec(grad, hits);
+        updated += hits;
+      }
+    }
+    window.addVec(grad, updated);
   }
 }
 
 void FastText::skipgram(Model& model, real lr,
                         const std::vector<int32_t>& line) {
+  std::vector<int32_t> targets;
   std::uniform_int_distribution<> uniform(1, args_->ws);
   for (int32_t w = 0; w < line.size(); w++) {
     int32_t boundary = uniform(model.rng);
     const std::vector<int32_t>& ngrams = dict_->getNgrams(line[w]);
+    targets.clear();
     for (int32_t c = -boundary; c <= boundary; c++) {
       if (c != 0 && w + c >= 0 && w + c < line.size()) {
-        model.update(ngrams, line[w + c], lr);
+        targets.push_back(line[w + c]);
       }
     }
+    model.update(ngrams, targets, lr);
   }
 }
 
-void FastText::test(std::istream& in, int32_t k) {
-  int32_t nexamples = 0, nlabels = 0;
-  double precision = 0.0;
-  std::vector<int32_t> line, labels;
+std::shared_ptr<InferenceSession> FastText::createSession(int32_t seed) const {
+  return std::make_shared<InferenceSession>(args_->dim, dict_->nlabels(), seed);
+}
 
-  while (in.peek() != EOF) {
-    dict_->getLine(in, line, labels, model_->rng);
-    dict_->addNgrams(line, args_->wordNgrams);
-    if (labels.size() > 0 && line.size() > 0) {
-      std::vector<std::pair<real, int32_t>> modelPredictions;
-      model_->predict(line, k, modelPredictions);
-      for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend(); it++) {
-        if (std::find(labels.begin(), labels.end(), it->second) != labels.end()) {
-          precision += 1.0;
-        }
-      }
-      nexamples++;
-      nlabels += labels.size();
+void FastText::predict(InferenceSession& session, const std::string& text,
+                       int32_t k) const {
+  dict_->getLine(text, session.words, session.labels, session.token);
+  dict_->addNgrams(session.words, args_->wordNgrams);
+  session.predictions.clear();
+  if (session.words.empty()) return;
+  model_->predict(session.words, k, session.predictions, session.frontier,
+                  session.hidden, session.output);
+}
+
+void FastText::predict(InferenceSession& session,
+                       const std::vector<const std::string*>& texts,
+                       int32_t k) const {
+  size_t n = 0;
+  session.batchLines.clear();
+  for (size_t i = 0; i < texts.size(); i++) {
+    if (session.batchWords.size() <= n) {
+      session.batchWords.resize(n + 1);
     }
+    std::vector<int32_t>& words = session.batchWords[n];
+    dict_->getLine(*texts[i], words, session.labels, session.token);
+    dict_->addNgrams(words, args_->wordNgrams);
+    // lines without words stay out of the batch and get no predictions
+    if (!words.empty()) {
+      session.batchLines.push_back(i);
+      n++;
+    }
+  }
+  if (session.batchHeaps.size() < n) {
+    session.batchHeaps.resize(n);
+  }
+  if (session.batchPredictions.size() < texts.size()) {
+    session.batchPredictions.resize(texts.size());
+  }
+  for (size_t i = 0; i < texts.size(); i++) {
+    session.batchPredictions[i].clear();
   }
+  model_->predict(session.batchWords, n, k, session.batchHeaps,
+                  session.frontier, session.hidden, session.output,
+                  session.batchScratch);
+  for (size_t j = 0; j < n; j++) {
+    session.batchPredictions[session.batchLines[j]].swap(session.batchHeaps[j]);
+  }
+}
+
+const std::string& FastText::getLabel(int32_t lid) const {
+  return dict_->getLabel(lid);
+}
+
+// reads chunks of lines on the calling thread, scores them on threads
+// sessions and hands the chunks to write in input order
+void FastText::predictLines(
+    std::istream& in, int32_t k, int32_t threads,
+    const std::function<void(LineChunk&, InferenceSession&)>& score,
+    const std::function<void(LineChunk&)>& write) const {
+  threads = std::max(threads, 1);
+  std::vector<std::shared_ptr<InferenceSession>> sessions;
+  for (int32_t i = 0; i < threads; i++) {
+    sessions.push_back(createSession(i));
+  }
+  OrderedPipeline<LineChunk> pipeline(threads, 2 * threads + 2);
+  pipeline.run(
+      [&](LineChunk& chunk) {
+        chunk.size = 0;
+        chunk.out.clear();
+        chunk.precision = 0.0;
+        chunk.nexamples = chunk.nlabels = 0;
+        chunk.nexact = chunk.nfound = 0;
+        chunk.lines.resize(PREDICT_CHUNK_SIZE);
+        while (chunk.size < PREDICT_CHUNK_SIZE &&
+               std::getline(in, chunk.lines[chunk.size])) {
+          chunk.size++;
+        }
+        return chunk.size > 0;
+      },
+      [&](LineChunk& chunk, int32_t worker) {
+        InferenceSession& session = *sessions[worker];
+        for (size_t i = 0; i < chunk.size; i++) {
+          predict(session, chunk.lines[i], k);
+          score(chunk, session);
+        }
+      },
+      write);
+}
+
+void FastText::test(std::istream& in, int32_t k, int32_t threads) {
+  int64_t nexamples = 0, nlabels = 0, nexact = 0, nfound = 0;
+  double precision = 0.0;
+  bool approximate = model_->hasLabelIndex();
+
+  predictLines(in, k, threads,
+      [this, k, approximate](LineChunk& chunk, InferenceSession& session) {
+        if (approximate && !session.words.empty()) {
+          session.reference.clear();
+          model_->predict(session.words, k, session.reference,
+                          session.frontier, session.hidden, session.output,
+                          true);
+          for (auto it = session.reference.cbegin();
+               it != session.reference.cend(); ++it) {
+            for (auto jt = session.predictions.cbegin();
+                 jt != session.predictions.cend(); ++jt) {
+              if (jt->second == it->second) {
+                chunk.nfound++;
+                break;
+              }
+            }
+          }
+          chunk.nexact += session.reference.size();
+        }
+        if (session.labels.empty() || session.predictions.empty()) return;
+        for (auto it = session.predictions.cbegin();
+             it != session.predictions.cend(); it++) {
+          if (std::find(session.labels.begin(), session.labels.end(),
+                        it->second) != session.labels.end()) {
+            chunk.precision += 1.0;
+          }
+        }
+        chunk.nexamples++;
+        chunk.nlabels += session.labels.size();
+      },
+      [&](LineChunk& chunk) {
+        precision += chunk.precision;
+        nexamples += chunk.nexamples;
+        nlabels += chunk.nlabels;
+        nexact += chunk.nexact;
+        nfound += chunk.nfound;
+      });
   std::cout << std::setprecision(3);
   std::cout << "P@" << k << ": " << precision / (k * nexamples) << std::endl;
   std::cout << "R@" << k << ": " << precision / nlabels << std::endl;
   std::cout << "Number of examples: " << nexamples << std::endl;
+  if (approximate) {
+    std::cout << "Recall of the label index@" << k << ": "
+              << double(nfound) / nexact << std::endl;
+  }
 }
 
 void FastText::predict(std::istream& in, int32_t k,
                        std::vector<std::pair<real,std::string>>& predictions) const {
-  std::vector<int32_t> words, labels;
-  dict_->getLine(in, words, labels, model_->rng);
-  dict_->addNgrams(words, args_->wordNgrams);
-  if (words.empty()) return;
-  Vector hidden(args_->dim);
-  Vector output(dict_->nlabels());
-  std::vector<std::pair<real,int32_t>> modelPredictions;
-  model_->predict(words, k, modelPredictions, hidden, output);
+  InferenceSession session(args_->dim, dict_->nlabels(), 0);
+  std::string line;
+  std::getline(in, line);
+  predict(session, line, k);
   predictions.clear();
-  for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend(); it++) {
+  for (auto it = session.predictions.cbegin(); it != session.predictions.cend(); it++) {
     predictions.push_back(std::make_pair(it->first, dict_->getLabel(it->second)));
   }
 }
 
-void FastText::predict(std::istream& in, int32_t k, bool print_prob) {
-  std::vector<std::pair<real,std::string>> predictions;
-  while (in.peek() != EOF) {
-    predict(in, k, predictions);
-    if (predictions.empty()) {
-      std::cout << "n/a" << std::endl;
-      continue;
+// labels of session.predictions, optionally followed by their probability,
+// or n/a when there is none
+void FastText::appendPredictions(const InferenceSession& session,
+                                 bool print_prob, std::string& out) const {
+  appendPredictions(session.predictions, print_prob, out);
+}
+
+void FastText::appendPredictions(
+    const std::vector<std::pair<real, int32_t>>& predictions, bool print_prob,
+    std::string& out) const {
+  if (predictions.empty()) {
+    out.append("n/a");
+    return;
+  }
+  char prob[32];
+  for (auto it = predictions.cbegin(); it != predictions.cend(); it++) {
+    if (it != predictions.cbegin()) {
+      out.push_back(' ');
     }
-    for (auto it = predictions.cbegin(); it != predictions.cend(); it++) {
-      if (it != predictions.cbegin()) {
-        std::cout << ' ';
-      }
-      std::cout << it->second;
-      if (print_prob) {
-        std::cout << ' ' << exp(it->first);
-      }
+    out.append(dict_->getLabel(it->second));
+    if (print_prob) {
+      // the default precision of std::cout
+      snprintf(prob, sizeof(prob), " %g", exp(it->first));
+      out.append(prob);
     }
-    std::cout << std::endl;
   }
 }
 
+void FastText::predict(std::istream& in, int32_t k, bool print_prob,
+                       int32_t threads) {
+  predictLines(in, k, threads,
+      [this, print_prob](LineChunk& chunk, InferenceSession& session) {
+        appendPredictions(session, print_prob, chunk.out);
+        chunk.out.push_back('\n');
+      },
+      [](LineChunk& chunk) {
+        std::cout.write(chunk.out.data(), chunk.out.size());
+      });
+  std::cout.flush();
+}
+
 void FastText::wordVectors() {
   std::string word;
   Vector vec(args_->dim);
@@ -241,34 +534,139 @@ void FastText::textVectors() {
   }
 }
 
-bool tcompare(std::pair<int32_t, real> first,
-             std::pair<int32_t, real> second) {
-  return (first.second > second.second);
+// builds an index of the word vectors and saves it to path
+void FastText::buildIndex(const std::string& path, int32_t M,
+                          int32_t efConstruction, int32_t threads) {
+  index_ = std::make_shared<HnswIndex>();
+  index_->build(*input_, dict_->nwords(), M, efConstruction, threads, 0);
+  std::ofstream ofs(path, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    std::cerr << "Index file cannot be opened for saving!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  index_->save(ofs);
+  ofs.close();
+}
+
+void FastText::loadIndex(const std::string& path) {
+  std::ifstream ifs(path, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    std::cerr << "Index file cannot be opened for loading!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  index_ = std::make_shared<HnswIndex>();
+  index_->load(ifs, *input_, dict_->nwords());
+  ifs.close();
 }
 
-void FastText::nbest() {
+void FastText::buildLabelIndex(const std::string& path, int32_t nlist,
+                               int32_t threads) {
+  if (args_->model != model_name::sup || args_->loss == loss_name::hs ||
+      args_->loss == loss_name::adaptive) {
+    std::cerr << "A label index needs a supervised softmax or ns model!"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (nlist <= 0) {
+    nlist = sqrt(dict_->nlabels());
+  }
+  auto index = std::make_shared<LabelIndex>();
+  index->build(*output_, nlist, LABEL_INDEX_ITERATIONS, threads, 0);
+  std::ofstream ofs(path, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    std::cerr << "Index file cannot be opened for saving!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  index->save(ofs);
+  ofs.close();
+}
+
+void FastText::loadLabelIndex(const std::string& path, int32_t nprobe) {
+  std::ifstream ifs(path, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    std::cerr << "Index file cannot be opened for loading!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  auto index = std::make_shared<LabelIndex>();
+  index->load(ifs, *output_);
+  ifs.close();
+  model_->setLabelIndex(index, nprobe);
+}
+
+const ExactIndex& FastText::exactIndex() {
+  if (!exact_) {
+    exact_ = std::make_shared<ExactIndex>();
+    exact_->build(*input_, dict_->nwords());
+  }
+  return *exact_;
+}
+
+// reads "word n" queries; with an index, ef trades recall for speed
+void FastText::nbest(int32_t ef) {
   std::string word;
   int32_t topN;
-  Vector vec(args_->dim);
-  std::vector<std::pair<int32_t, real>> id2prob(dict_->nwords());
+  std::vector<std::vector<ExactIndex::Neighbor>> results(1);
+  std::vector<ExactIndex::Neighbor>& neighbors = results[0];
   while (std::cin >> word >> topN) {
     auto id = dict_->getId(word);
     if (id < 0) continue;
-    input_->getRow(id, vec);  
-    Vector curVec(args_->dim);
-    for (int32_t i = 0; i < dict_->nwords(); i++) {
-      if (i != id) {
-        input_->getRow(i, curVec);
-        real cos = cosine(vec, curVec);
-        id2prob[i] = std::make_pair(i, cos);
-      }
+    if (index_) {
+      index_->search(index_->vector(id), topN + 1, ef, neighbors);
+    } else {
+      const ExactIndex& exact = exactIndex();
+      exact.search(exact.vector(id), 1, topN + 1, results);
     }
-    std::sort(id2prob.begin(), id2prob.end(), tcompare);
-    for (int i = 0; i < topN; i++) {
-      std::cout << dict_->getWord(id2prob[i].first) << " " << id2prob[i].second << std::endl;
+    int32_t printed = 0;
+    for (auto it = neighbors.cbegin();
+         it != neighbors.cend() && printed < topN; ++it) {
+      if (it->second == id) continue;
+      std::cout << dict_->getWord(it->second) << " " << it->first << std::endl;
+      printed++;
     }
   }
 }
+
+void FastText::allNeighbors(int32_t k, int32_t threads) {
+  const ExactIndex& exact = exactIndex();
+  int32_t nwords = dict_->nwords();
+  int32_t next = 0;
+  threads = std::max(threads, 1);
+  OrderedPipeline<NeighborChunk> pipeline(threads, 2 * threads + 2);
+  pipeline.run(
+      [&](NeighborChunk& chunk) {
+        chunk.begin = next;
+        chunk.end = std::min(next + NEIGHBOR_CHUNK_SIZE, nwords);
+        next = chunk.end;
+        return chunk.begin < chunk.end;
+      },
+      [&](NeighborChunk& chunk, int32_t) {
+        exact.search(exact.vector(chunk.begin), chunk.end - chunk.begin,
+                     k + 1, chunk.neighbors);
+        chunk.out.clear();
+        char score[32];
+        for (int32_t i = chunk.begin; i < chunk.end; i++) {
+          const std::vector<ExactIndex::Neighbor>& neighbors =
+              chunk.neighbors[i - chunk.begin];
+          chunk.out.append(dict_->getWord(i));
+          int32_t printed = 0;
+          for (auto it = neighbors.cbegin();
+               it != neighbors.cend() && printed < k; ++it) {
+            if (it->second == i) continue;
+            snprintf(score, sizeof(score), " %g", it->first);
+            chunk.out.push_back(' ');
+            chunk.out.append(dict_->getWord(it->second));
+            chunk.out.append(score);
+            printed++;
+          }
+          chunk.out.push_back('\n');
+        }
+      },
+      [](NeighborChunk& chunk) {
+        std::cout.write(chunk.out.data(), chunk.out.size());
+      });
+  std::cout.flush();
+}
+
 void FastText::printVectors() {
   if (args_->model == model_name::sup) {
     textVectors();
@@ -278,25 +676,62 @@ void FastText::printVectors() {
 }
 
 void FastText::trainThread(int32_t threadId) {
-  std::ifstream ifs(args_->input);
-  utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
+  std::ifstream ifs;
+  ExampleQueue::Batch* batch = nullptr;
+  size_t next = 0;
+  if (!queue_) {
+    ifs.open(args_->input);
+    if (positions_.get(threadId) >= 0) {
+      utils::seek(ifs, positions_.get(threadId));
+    } else {
+      // every process reads its own share of the file
+      int64_t slice = args_->rank * args_->thread + threadId;
+      utils::seek(ifs, slice * utils::size(ifs) / (args_->workers * args_->thread));
+    }
+  }
 
-  Model model(input_, output_, args_, threadId);
+  std::shared_ptr<Matrix> input = input_;
+  std::shared_ptr<Matrix> output = output_;
+  if (nodes_ > 1) {
+    int32_t node = threadId * nodes_ / args_->thread;
+    numa::bind(node);
+    input = inputs_->get(node);
+    output = outputs_->get(node);
+  }
+  Model model(input, output, args_, threadId);
   if (args_->model == model_name::sup) {
     model.setTargetCounts(dict_->getCounts(entry_type::label));
   } else {
     model.setTargetCounts(dict_->getCounts(entry_type::word));
   }
+  if (args_->hotRows > 0) {
+    model.initHotRows();
+  }
+  if (cluster_) {
+    model.setTrackers(cluster_->tracker(0), cluster_->tracker(1));
+  }
 
-  const int64_t ntokens = dict_->ntokens();
+  const int64_t ntokens = args_->epoch * dict_->ntokens() / args_->workers;
   int64_t localTokenCount = 0;
+  // between two reads of the shared total the other threads are assumed to
+  // progress at the same pace as this one
+  int64_t tokenCount = tokenCount_->total();
   std::vector<int32_t> line, labels;
-  while (tokenCount < args_->epoch * ntokens) {
-    real progress = real(tokenCount) / (args_->epoch * ntokens);
+  while (tokenCount + localTokenCount * args_->thread < ntokens && !stop_) {
+    real progress = real(tokenCount + localTokenCount * args_->thread) / ntokens;
     real lr = args_->lr * (1.0 - progress);
-    localTokenCount += dict_->getLine(ifs, line, labels, model.rng);
+    if (queue_) {
+      int32_t ntokens;
+      if (!nextExample(batch, next, line, labels, ntokens)) break;
+      localTokenCount += ntokens;
+    } else {
+      localTokenCount += dict_->getLine(ifs, line, labels, model.rng,
+                                        args_->model != model_name::sup);
+      if (args_->model == model_name::sup) {
+        dict_->addNgrams(line, args_->wordNgrams);
+      }
+    }
     if (args_->model == model_name::sup) {
-      dict_->addNgrams(line, args_->wordNgrams);
       supervised(model, lr, line, labels);
     } else if (args_->model == model_name::cbow) {
       cbow(model, lr, line);
@@ -304,20 +739,195 @@ void FastText::trainThread(int32_t threadId) {
       skipgram(model, lr, line);
     }
     if (localTokenCount > args_->lrUpdateRate) {
-      tokenCount += localTokenCount;
+      tokenCount_->add(threadId, localTokenCount);
+      tokenCount = tokenCount_->total();
       localTokenCount = 0;
+      if (checkpointer_) {
+        // readers share the file, so there is no offset to resume from
+        if (queue_) {
+          positions_.set(threadId, -1);
+        } else {
+          positions_.track(threadId, ifs);
+        }
+        if (threadId == 0 && checkpointer_->due()) {
+          saveCheckpoint();
+        }
+      }
       if (threadId == 0 && args_->verbose > 1) {
         printInfo(progress, model.getLoss());
       }
     }
   }
+  model.flush();
   if (threadId == 0 && args_->verbose > 0) {
     printInfo(1.0, model.getLoss());
     std::cout << std::endl;
   }
+  if (batch) {
+    queue_->release(batch);
+  }
   ifs.close();
 }
 
+bool FastText::nextExample(ExampleQueue::Batch*& batch, size_t& next,
+                           std::vector<int32_t>& line,
+                           std::vector<int32_t>& labels, int32_t& ntokens) {
+  if (batch && next == batch->size) {
+    queue_->release(batch);
+    batch = nullptr;
+  }
+  if (!batch) {
+    batch = queue_->pop();
+    next = 0;
+    if (!batch) return false;
+  }
+  const Example& example = batch->examples[next++];
+  line.assign(example.words.cbegin(), example.words.cend());
+  labels.assign(example.labels.cbegin(), example.labels.cend());
+  ntokens = example.ntokens;
+  return true;
+}
+
+// Readers loop over their slice of the input like trainers do and hand
+// tokenized lines over in batches until training is done.
+void FastText::readThread(int32_t readerId) {
+  std::ifstream ifs(args_->input);
+  int64_t slice = args_->rank * args_->ioThread + readerId;
+  utils::seek(ifs, slice * utils::size(ifs) / (args_->workers * args_->ioThread));
+  std::minstd_rand rng(args_->thread + readerId);
+  bool subsample = args_->model != model_name::sup;
+  ExampleQueue::Batch* batch;
+  while ((batch = queue_->acquire()) != nullptr) {
+    for (batch->size = 0; batch->size < READ_BATCH_SIZE; batch->size++) {
+      if (batch->size == batch->examples.size()) {
+        batch->examples.push_back(Example());
+      }
+      Example& example = batch->examples[batch->size];
+      example.ntokens = dict_->getLine(ifs, example.words, example.labels,
+                                       rng, subsample);
+      if (args_->model == model_name::sup) {
+        dict_->addNgrams(example.words, args_->wordNgrams);
+      }
+    }
+    queue_->push(batch);
+  }
+  ifs.close();
+}
+
+// Each node averages its own slice of rows so that the traffic is spread
+// over all memory controllers.
+void FastText::averageThread(int32_t node, const std::atomic<bool>& done) {
+  numa::bind(node);
+  int64_t inBegin = node * input_->m_ / nodes_;
+  int64_t inEnd = (node + 1) * input_->m_ / nodes_;
+  int64_t outBegin = node * output_->m_ / nodes_;
+  int64_t outEnd = (node + 1) * output_->m_ / nodes_;
+  while (!done) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(std::max(args_->numaSync, 1)));
+    inputs_->average(inBegin, inEnd);
+    outputs_->average(outBegin, outEnd);
+  }
+}
+
+void FastText::syncThread(const std::atomic<bool>& done) {
+  bool active = true;
+  while (active) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(std::max(args_->syncInterval, 1)));
+    active = cluster_->sync(done);
+  }
+}
+
+void FastText::loadValid() {
+  std::ifstream ifs(args_->valid);
+  if (!ifs.is_open()) {
+    std::cerr << "Validation file cannot be opened!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::vector<int32_t> line, labels;
+  std::minstd_rand rng(0);
+  validLines_.clear();
+  validLabels_.clear();
+  while (ifs.peek() != EOF) {
+    dict_->getLine(ifs, line, labels, rng);
+    dict_->addNgrams(line, args_->wordNgrams);
+    if (labels.size() > 0 && line.size() > 0) {
+      validLines_.push_back(line);
+      validLabels_.push_back(labels);
+    }
+  }
+  ifs.close();
+}
+
+real FastText::validate(const Model& model) const {
+  Vector hidden(args_->dim);
+  Vector output(dict_->nlabels());
+  std::vector<std::pair<real, int32_t>> predictions, frontier;
+  int64_t correct = 0;
+  for (size_t i = 0; i < validLines_.size(); i++) {
+    predictions.clear();
+    model.predict(validLines_[i], 1, predictions, frontier, hidden, output);
+    const std::vector<int32_t>& labels = validLabels_[i];
+    if (!predictions.empty() &&
+        std::find(labels.begin(), labels.end(),
+                  predictions[0].second) != labels.end()) {
+      correct++;
+    }
+  }
+  return real(correct) / validLines_.size();
+}
+
+void FastText::validThread() {
+  // evaluates snapshots so the trainers are never paused
+  Checkpointer validator(Checkpointer::Matrices{input_, output_},
+                         std::max(args_->validInterval, 1));
+  const Checkpointer::Matrices& staged = validator.staged();
+  Model model(staged[0], staged[1], args_, 0);
+  model.setTargetCounts(dict_->getCounts(entry_type::label));
+
+  std::shared_ptr<Args> args = args_;
+  std::shared_ptr<Dictionary> dict = dict_;
+  Checkpointer::Writer writer = [args, dict](std::ostream& out,
+                                             const Checkpointer::Matrices& m) {
+    args->save(out);
+    dict->save(out);
+    m[0]->save(out);
+    m[1]->save(out);
+  };
+
+  real best = -1.0;
+  int32_t bad = 0;
+  bool last = false;
+  while (!last) {
+    while (!validator.due() && !trained_) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    last = trained_;
+    validator.snapshot();
+    real precision = validate(model);
+    if (precision > best) {
+      best = precision;
+      bad = 0;
+      validator.write({{args_->output + ".bin", writer}});
+    } else if (args_->patience > 0 && ++bad >= args_->patience) {
+      stop_ = true;
+    }
+    if (args_->verbose > 0) {
+      std::cout << std::endl << std::setprecision(3);
+      std::cout << "Validation P@1: " << precision << "  best: " << best;
+      std::cout << (stop_ ? "  stopping" : "") << std::endl;
+    }
+    if (stop_) {
+      while (!trained_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      last = true;
+    }
+  }
+  validator.wait();
+}
+
 void FastText::loadVectors(std::string filename) {
   std::ifstream in(filename);
   std::vector<std::string> words;
@@ -347,7 +957,8 @@ void FastText::loadVectors(std::string filename) {
 
   dict_->threshold(1, 0);
   input_ = std::make_shared<Matrix>(dict_->nwords() + args_->bucket, args_->dim);
-  input_->uniform(1.0 / args_->dim);
+  input_->lazyUniform(1.0 / args_->dim,
+                      args_->lazyBuckets ? dict_->nwords() : input_->m_);
 
   for (size_t i = 0; i < n; i++) {
     int32_t idx = dict_->getId(words[i]);
@@ -360,36 +971,96 @@ void FastText::loadVectors(std::string filename) {
 
 void FastText::train(std::shared_ptr<Args> args) {
   args_ = args;
+  Matrix::hugePages = args_->hugePages;
   dict_ = std::make_shared<Dictionary>(args_);
   if (args_->input == "-") {
     // manage expectations
     std::cerr << "Cannot use stdin for training!" << std::endl;
     exit(EXIT_FAILURE);
   }
-  std::ifstream ifs(args_->input);
-  if (!ifs.is_open()) {
-    std::cerr << "Input file cannot be opened!" << std::endl;
-    exit(EXIT_FAILURE);
+  TrainState state;
+  if (!args_->resume.empty()) {
+    loadCheckpoint(args_->resume, state);
+  } else {
+    std::ifstream ifs(args_->input);
+    if (!ifs.is_open()) {
+      std::cerr << "Input file cannot be opened!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    dict_->readFromFile(ifs, 0, 1);
+    ifs.close();
+
+    if (args_->pretrainedVectors.size() != 0) {
+      loadVectors(args_->pretrainedVectors);
+    } else {
+      input_ = std::make_shared<Matrix>(dict_->nwords() + args_->bucket, args_->dim);
+      input_->lazyUniform(1.0 / args_->dim,
+                          args_->lazyBuckets ? dict_->nwords() : input_->m_);
+    }
+
+    entry_type target = (args_->model == model_name::sup) ?
+      entry_type::label : entry_type::word;
+    int64_t osz = Model::outputSize(*args_, dict_->getCounts(target));
+    output_ = std::make_shared<Matrix>(osz, args_->dim);
+    output_->zero();
   }
-  dict_->readFromFile(ifs, 0, 1);
-  ifs.close();
 
-  if (args_->pretrainedVectors.size() != 0) {
-    loadVectors(args_->pretrainedVectors);
-  } else {
-    input_ = std::make_shared<Matrix>(dict_->nwords() + args_->bucket, args_->dim);
-    input_->uniform(1.0 / args_->dim);
+  positions_.reset(args_->thread, state.positions);
+  if (args_->checkpointInterval > 0 && args_->rank == 0) {
+    checkpointer_ = std::make_shared<Checkpointer>(
+        Checkpointer::Matrices{input_, output_}, args_->checkpointInterval);
   }
 
-  if (args_->model == model_name::sup) {
-    output_ = std::make_shared<Matrix>(dict_->nlabels(), args_->dim);
-  } else {
-    output_ = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
+  nodes_ = args_->numa ? std::min(numa::nodes(), args_->thread) : 1;
+  if (nodes_ > 1) {
+    // replicas are averaged as whole buffers
+    input_->materialize();
+    inputs_ = std::make_shared<Replicas>(input_, nodes_);
+    outputs_ = std::make_shared<Replicas>(output_, nodes_);
+  }
+
+  if (args_->workers > 1) {
+    cluster_ = std::make_shared<Cluster>(
+        args_, Cluster::Matrices{input_, output_},
+        std::vector<bool>{true, true});
+  }
+
+  // rank 0 holds the merged model, the other processes save nothing
+  bool saving = !cluster_ || cluster_->rank() == 0;
+  bool validating = saving && args_->model == model_name::sup &&
+                    !args_->valid.empty();
+  if (validating) {
+    loadValid();
+    validating = !validLines_.empty();
   }
-  output_->zero();
 
   start = clock();
-  tokenCount = 0;
+  tokenCount_ = std::make_shared<ProgressCounter>(args_->thread,
+                                                  state.tokenCount);
+  stop_ = false;
+  trained_ = false;
+  std::thread validator;
+  if (validating) {
+    validator = std::thread([=]() { validThread(); });
+  }
+  std::atomic<bool> done(false);
+  std::vector<std::thread> averagers;
+  for (int32_t i = 0; i < nodes_ && nodes_ > 1; i++) {
+    averagers.push_back(std::thread([=, &done]() { averageThread(i, done); }));
+  }
+  std::atomic<bool> finished(false);
+  std::thread syncer;
+  if (cluster_) {
+    syncer = std::thread([=, &finished]() { syncThread(finished); });
+  }
+  std::vector<std::thread> readers;
+  if (args_->ioThread > 0) {
+    queue_ = std::make_shared<ExampleQueue>(
+        4 * std::max(args_->thread, args_->ioThread));
+    for (int32_t i = 0; i < args_->ioThread; i++) {
+      readers.push_back(std::thread([=]() { readThread(i); }));
+    }
+  }
   std::vector<std::thread> threads;
   for (int32_t i = 0; i < args_->thread; i++) {
     threads.push_back(std::thread([=]() { trainThread(i); }));
@@ -397,9 +1068,46 @@ void FastText::train(std::shared_ptr<Args> args) {
   for (auto it = threads.begin(); it != threads.end(); ++it) {
     it->join();
   }
+  if (queue_) {
+    queue_->close();
+    for (auto it = readers.begin(); it != readers.end(); ++it) {
+      it->join();
+    }
+    queue_.reset();
+  }
+  done = true;
+  for (auto it = averagers.begin(); it != averagers.end(); ++it) {
+    it->join();
+  }
+  if (nodes_ > 1) {
+    // replica 0 is input_/output_ and holds the final model
+    inputs_->average(0, input_->m_);
+    outputs_->average(0, output_->m_);
+    inputs_.reset();
+    outputs_.reset();
+  }
+  if (cluster_) {
+    // the last round sends the final rows of this process
+    finished = true;
+    syncer.join();
+    cluster_.reset();
+  }
+  trained_ = true;
+  if (validating) {
+    // the validator saves the best model itself
+    validator.join();
+  }
+  if (checkpointer_) {
+    checkpointer_->wait();
+  }
   model_ = std::make_shared<Model>(input_, output_, args_, 0);
 
-  saveModel();
+  if (!saving) {
+    return;
+  }
+  if (!validating) {
+    saveModel();
+  }
   if (args_->model != model_name::sup) {
     saveVectors();
   }
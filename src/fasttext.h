@@ -13,12 +13,21 @@
 #include <time.h>
 
 #include <atomic>
+#include <functional>
 #include <memory>
 
+#include "checkpoint.h"
+#include "cluster.h"
 #include "matrix.h"
 #include "vector.h"
 #include "dictionary.h"
+#include "hnsw.h"
+#include "knn.h"
 #include "model.h"
+#include "numa.h"
+#include "progress.h"
+#include "ring.h"
+#include "session.h"
 #include "utils.h"
 #include "real.h"
 #include "args.h"
@@ -27,39 +36,123 @@ namespace fasttext {
 
 class FastText {
   private:
+    struct Example {
+      std::vector<int32_t> words;
+      std::vector<int32_t> labels;
+      int32_t ntokens;
+    };
+    typedef BatchQueue<Example> ExampleQueue;
+    // consecutive input lines with what was computed for them
+    struct LineChunk {
+      std::vector<std::string> lines;
+      size_t size;
+      std::string out;
+      double precision;
+      int64_t nexamples;
+      int64_t nlabels;
+      // exact top-k labels, and how many of them the label index found
+      int64_t nexact;
+      int64_t nfound;
+    };
+    // a range of words with their nearest neighbours
+    struct NeighborChunk {
+      int32_t begin;
+      int32_t end;
+      std::vector<std::vector<ExactIndex::Neighbor>> neighbors;
+      std::string out;
+    };
+
     std::shared_ptr<Args> args_;
     std::shared_ptr<Dictionary> dict_;
     std::shared_ptr<Matrix> input_;
     std::shared_ptr<Matrix> output_;
     std::shared_ptr<Model> model_;
-    std::atomic<int64_t> tokenCount;
+    std::shared_ptr<ProgressCounter> tokenCount_;
     clock_t start;
+    std::shared_ptr<Checkpointer> checkpointer_;
+    FilePositions positions_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> trained_;
+    std::vector<std::vector<int32_t>> validLines_;
+    std::vector<std::vector<int32_t>> validLabels_;
+    int32_t nodes_;
+    std::shared_ptr<Replicas> inputs_;
+    std::shared_ptr<Replicas> outputs_;
+    std::shared_ptr<Cluster> cluster_;
+    std::shared_ptr<ExampleQueue> queue_;
+    // approximate neighbours of the word vectors, when loaded
+    std::shared_ptr<HnswIndex> index_;
+    // normalized word vectors for exact neighbours, built on first use
+    std::shared_ptr<ExactIndex> exact_;
+
+    static const int32_t READ_BATCH_SIZE = 64;
+    static const size_t PREDICT_CHUNK_SIZE = 256;
+    static const int32_t NEIGHBOR_CHUNK_SIZE = 256;
+    static const int32_t LABEL_INDEX_ITERATIONS = 10;
+
+    bool nextExample(ExampleQueue::Batch*&, size_t&,
+                     std::vector<int32_t>&, std::vector<int32_t>&, int32_t&);
+    void predictLines(std::istream&, int32_t, int32_t,
+                      const std::function<void(LineChunk&,
+                                               InferenceSession&)>&,
+                      const std::function<void(LineChunk&)>&) const;
+    const ExactIndex& exactIndex();
 
   public:
     void getVector(Vector&, const std::string&) const;
+    void getVector(InferenceSession&, Vector&, const std::string&) const;
     void saveVectors();
     void saveModel();
     void loadModel(const std::string&);
     void loadModel(std::istream&);
+    void saveCheckpoint();
+    void loadCheckpoint(const std::string&, TrainState&);
     void printInfo(real, real);
 
     void supervised(Model&, real, const std::vector<int32_t>&,
                     const std::vector<int32_t>&);
     void cbow(Model&, real, const std::vector<int32_t>&);
     void skipgram(Model&, real, const std::vector<int32_t>&);
-    void test(std::istream&, int32_t);
-    void predict(std::istream&, int32_t, bool);
+    void test(std::istream&, int32_t, int32_t);
+    void predict(std::istream&, int32_t, bool, int32_t);
     void predict(std::istream&, int32_t, std::vector<std::pair<real,std::string>>&) const;
+    std::shared_ptr<InferenceSession> createSession(int32_t seed = 0) const;
+    // top k labels of one line into session.predictions
+    void predict(InferenceSession&, const std::string&, int32_t) const;
+    // top k labels of several lines scored together, into
+    // session.batchPredictions
+    void predict(InferenceSession&, const std::vector<const std::string*>&,
+                 int32_t) const;
+    const std::string& getLabel(int32_t) const;
+    void appendPredictions(const InferenceSession&, bool, std::string&) const;
+    void appendPredictions(const std::vector<std::pair<real, int32_t>>&, bool,
+                           std::string&) const;
     void wordVectors();
     void textVectors();
-    void nbest();
+    void buildIndex(const std::string&, int32_t, int32_t, int32_t);
+    void loadIndex(const std::string&);
+    void nbest(int32_t);
+    // label index of a softmax or ns model with nlist lists (0 for the
+    // square root of the labels), searched with nprobe lists
+    void buildLabelIndex(const std::string&, int32_t, int32_t);
+    void loadLabelIndex(const std::string&, int32_t);
+    // the k nearest neighbours of every word, in vocabulary order
+    void allNeighbors(int32_t, int32_t);
     void printVectors();
     void trainThread(int32_t);
+    void readThread(int32_t);
+    void loadValid();
+    real validate(const Model&) const;
+    void validThread();
+    void averageThread(int32_t, const std::atomic<bool>&);
+    void syncThread(const std::atomic<bool>&);
     void train(std::shared_ptr<Args>);
 
     void loadVectors(std::string);
 
-    int32_t getDim() const { args_->dim; }
+    int32_t getDim() const { return args_->dim; }
+    // tree nodes kept while predicting with hs, 0 for the exact top k
+    void setBeam(int32_t beam) { args_->beam = beam; }
 };
 
 }
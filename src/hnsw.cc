@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "hnsw.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <thread>
+
+#include "knn.h"
+
+namespace fasttext {
+
+// nodes seen by one search, reset by bumping the tag
+struct HnswIndex::Visited {
+  std::vector<uint16_t> marks;
+  uint16_t tag;
+
+  explicit Visited(int64_t n) : marks(n, 0), tag(0) {}
+
+  void next() {
+    if (++tag == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      tag = 1;
+    }
+  }
+
+  bool visit(int32_t i) {
+    if (marks[i] == tag) {
+      return false;
+    }
+    marks[i] = tag;
+    return true;
+  }
+};
+
+HnswIndex::HnswIndex()
+  : n_(0), dim_(0), M_(0), M0_(0), efConstruction_(0), entry_(0),
+    maxLevel_(0), building_(false) {}
+
+HnswIndex::~HnswIndex() {}
+
+int64_t HnswIndex::size() const {
+  return n_;
+}
+
+const real* HnswIndex::vector(int32_t i) const {
+  return data_.data() + int64_t(i) * dim_;
+}
+
+void HnswIndex::normalize(const Matrix& matrix, int64_t n) {
+  n_ = n;
+  dim_ = matrix.n_;
+  normalizeRows(matrix, n, data_);
+}
+
+// minus the cosine of a normalized query and row i
+real HnswIndex::distance(const real* query, int32_t i) const {
+  const real* row = vector(i);
+  real dot = 0.0;
+  for (int32_t j = 0; j < dim_; j++) {
+    dot += query[j] * row[j];
+  }
+  return -dot;
+}
+
+int32_t* HnswIndex::links(int32_t node, int32_t level) {
+  if (level == 0) {
+    return links0_.data() + int64_t(node) * (M0_ + 1);
+  }
+  return upper_[node].data() + (level - 1) * (M_ + 1);
+}
+
+const int32_t* HnswIndex::links(int32_t node, int32_t level) const {
+  return const_cast<HnswIndex*>(this)->links(node, level);
+}
+
+// a copy of the links of node, taken under its lock while building
+void HnswIndex::neighbors(int32_t node, int32_t level,
+                          std::vector<int32_t>& out) const {
+  std::unique_lock<std::mutex> lock;
+  if (building_) {
+    lock = std::unique_lock<std::mutex>(locks_[node % NLOCKS]);
+  }
+  const int32_t* l = links(node, level);
+  out.assign(l + 1, l + 1 + l[0]);
+}
+
+// walks down from layer from to the layer above to, always moving to the
+// closest neighbour
+int32_t HnswIndex::greedy(const real* query, int32_t node, int32_t from,
+                          int32_t to) const {
+  real best = distance(query, node);
+  std::vector<int32_t> next;
+  for (int32_t level = from; level > to; level--) {
+    bool moved = true;
+    while (moved) {
+      moved = false;
+      neighbors(node, level, next);
+      for (auto it = next.cbegin(); it != next.cend(); ++it) {
+        real d = distance(query, *it);
+        if (d < best) {
+          best = d;
+          node = *it;
+          moved = true;
+        }
+      }
+    }
+  }
+  return node;
+}
+
+// the ef closest nodes reachable from entry on one layer, closest first
+void HnswIndex::searchLayer(const real* query, int32_t entry, int32_t ef,
+                            int32_t level, Visited& visited,
+                            std::vector<Candidate>& out) const {
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate>> candidates;
+  std::priority_queue<Candidate> found;
+  std::vector<int32_t> next;
+  visited.next();
+  visited.visit(entry);
+  real d = distance(query, entry);
+  candidates.push(std::make_pair(d, entry));
+  found.push(std::make_pair(d, entry));
+  while (!candidates.empty()) {
+    Candidate current = candidates.top();
+    if (current.first > found.top().first && found.size() >= size_t(ef)) {
+      break;
+    }
+    candidates.pop();
+    neighbors(current.second, level, next);
+    for (auto it = next.cbegin(); it != next.cend(); ++it) {
+      if (!visited.visit(*it)) continue;
+      d = distance(query, *it);
+      if (found.size() < size_t(ef) || d < found.top().first) {
+        candidates.push(std::make_pair(d, *it));
+        found.push(std::make_pair(d, *it));
+        if (found.size() > size_t(ef)) {
+          found.pop();
+        }
+      }
+    }
+  }
+  out.resize(found.size());
+  for (size_t i = out.size(); i > 0; i--) {
+    out[i - 1] = found.top();
+    found.pop();
+  }
+}
+
+// keeps at most M candidates, skipping those closer to an already kept one
+// than to the base node, so links point in different directions
+void HnswIndex::select(std::vector<Candidate>& candidates, int32_t M) const {
+  if (candidates.size() <= size_t(M)) {
+    return;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < candidates.size() && kept < size_t(M); i++) {
+    const real* v = vector(candidates[i].second);
+    bool diverse = true;
+    for (size_t j = 0; j < kept && diverse; j++) {
+      diverse = distance(v, candidates[j].second) >= candidates[i].first;
+    }
+    if (diverse) {
+      candidates[kept++] = candidates[i];
+    }
+  }
+  candidates.resize(kept);
+}
+
+void HnswIndex::connect(int32_t node, int32_t level,
+                        const std::vector<Candidate>& selected) {
+  const int32_t maxM = level == 0 ? M0_ : M_;
+  {
+    std::lock_guard<std::mutex> lock(locks_[node % NLOCKS]);
+    int32_t* l = links(node, level);
+    l[0] = selected.size();
+    for (size_t i = 0; i < selected.size(); i++) {
+      l[i + 1] = selected[i].second;
+    }
+  }
+  std::vector<Candidate> candidates;
+  for (auto it = selected.cbegin(); it != selected.cend(); ++it) {
+    int32_t other = it->second;
+    std::lock_guard<std::mutex> lock(locks_[other % NLOCKS]);
+    int32_t* l = links(other, level);
+    if (l[0] < maxM) {
+      l[++l[0]] = node;
+      continue;
+    }
+    const real* v = vector(other);
+    candidates.clear();
+    candidates.push_back(std::make_pair(distance(v, node), node));
+    for (int32_t i = 1; i <= l[0]; i++) {
+      candidates.push_back(std::make_pair(distance(v, l[i]), l[i]));
+    }
+    std::sort(candidates.begin(), candidates.end());
+    select(candidates, maxM);
+    l[0] = candidates.size();
+    for (size_t i = 0; i < candidates.size(); i++) {
+      l[i + 1] = candidates[i].second;
+    }
+  }
+}
+
+void HnswIndex::insert(int32_t node, Visited& visited) {
+  const int32_t level = levels_[node];
+  // a node above the current top layer becomes the entry point, and no other
+  // such node may be inserted meanwhile
+  std::unique_lock<std::mutex> top(entryMutex_);
+  int32_t entry = entry_, maxLevel = maxLevel_;
+  if (level <= maxLevel) {
+    top.unlock();
+  }
+  const real* query = vector(node);
+  int32_t current = greedy(query, entry, maxLevel, level);
+  std::vector<Candidate> found;
+  for (int32_t l = std::min(level, maxLevel); l >= 0; l--) {
+    searchLayer(query, current, efConstruction_, l, visited, found);
+    current = found[0].second;
+    select(found, M_);
+    connect(node, l, found);
+  }
+  if (level > maxLevel) {
+    entry_ = node;
+    maxLevel_ = level;
+  }
+}
+
+void HnswIndex::build(const Matrix& matrix, int64_t n, int32_t M,
+                      int32_t efConstruction, int32_t threads,
+                      int32_t seed) {
+  normalize(matrix, n);
+  M_ = std::max(M, 2);
+  M0_ = 2 * M_;
+  efConstruction_ = std::max(efConstruction, M_);
+  std::minstd_rand rng(seed);
+  std::uniform_real_distribution<> uniform(0, 1);
+  const double mult = 1.0 / log(M_);
+  levels_.resize(n_);
+  upper_.assign(n_, std::vector<int32_t>());
+  for (int64_t i = 0; i < n_; i++) {
+    levels_[i] = int32_t(-log(1.0 - uniform(rng)) * mult);
+    upper_[i].assign(levels_[i] * (M_ + 1), 0);
+  }
+  links0_.assign(n_ * (M0_ + 1), 0);
+  if (n_ == 0) {
+    return;
+  }
+  locks_.reset(new std::mutex[NLOCKS]);
+  building_ = true;
+  entry_ = 0;
+  maxLevel_ = levels_[0];
+  std::atomic<int64_t> next(1);
+  std::vector<std::thread> workers;
+  for (int32_t t = 0; t < std::max(threads, 1); t++) {
+    workers.push_back(std::thread([&]() {
+      std::unique_ptr<Visited> visited = acquire();
+      for (int64_t i = next++; i < n_; i = next++) {
+        insert(i, *visited);
+      }
+      release(std::move(visited));
+    }));
+  }
+  for (auto it = workers.begin(); it != workers.end(); ++it) {
+    it->join();
+  }
+  building_ = false;
+}
+
+void HnswIndex::search(const real* query, int32_t k, int32_t ef,
+                       std::vector<std::pair<real, int32_t>>& out) const {
+  out.clear();
+  if (n_ == 0 || k <= 0) {
+    return;
+  }
+  std::vector<real> q(query, query + dim_);
+  double norm = 0.0;
+  for (int32_t j = 0; j < dim_; j++) {
+    norm += q[j] * q[j];
+  }
+  if (norm > 0.0) {
+    for (int32_t j = 0; j < dim_; j++) {
+      q[j] /= sqrt(norm);
+    }
+  }
+  int32_t node = greedy(q.data(), entry_, maxLevel_, 0);
+  std::vector<Candidate> found;
+  std::unique_ptr<Visited> visited = acquire();
+  searchLayer(q.data(), node, std::max(ef, k), 0, *visited, found);
+  release(std::move(visited));
+  for (size_t i = 0; i < found.size() && i < size_t(k); i++) {
+    out.push_back(std::make_pair(-found[i].first, found[i].second));
+  }
+}
+
+std::unique_ptr<HnswIndex::Visited> HnswIndex::acquire() const {
+  std::lock_guard<std::mutex> lock(visitedMutex_);
+  if (visited_.empty()) {
+    return std::unique_ptr<Visited>(new Visited(n_));
+  }
+  std::unique_ptr<Visited> visited = std::move(visited_.back());
+  visited_.pop_back();
+  return visited;
+}
+
+void HnswIndex::release(std::unique_ptr<Visited> visited) const {
+  std::lock_guard<std::mutex> lock(visitedMutex_);
+  visited_.push_back(std::move(visited));
+}
+
+void HnswIndex::save(std::ostream& out) const {
+  int32_t magic = MAGIC;
+  out.write((char*) &magic, sizeof(int32_t));
+  out.write((char*) &n_, sizeof(int64_t));
+  out.write((char*) &dim_, sizeof(int32_t));
+  out.write((char*) &M_, sizeof(int32_t));
+  out.write((char*) &maxLevel_, sizeof(int32_t));
+  out.write((char*) &entry_, sizeof(int32_t));
+  out.write((char*) levels_.data(), n_ * sizeof(int32_t));
+  out.write((char*) links0_.data(), links0_.size() * sizeof(int32_t));
+  for (int64_t i = 0; i < n_; i++) {
+    out.write((char*) upper_[i].data(), upper_[i].size() * sizeof(int32_t));
+  }
+}
+
+void HnswIndex::load(std::istream& in, const Matrix& matrix, int64_t n) {
+  int32_t magic, dim;
+  int64_t size;
+  in.read((char*) &magic, sizeof(int32_t));
+  in.read((char*) &size, sizeof(int64_t));
+  in.read((char*) &dim, sizeof(int32_t));
+  if (!in || magic != MAGIC || size != n || dim != matrix.n_) {
+    std::cerr << "Index does not match the model!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  in.read((char*) &M_, sizeof(int32_t));
+  in.read((char*) &maxLevel_, sizeof(int32_t));
+  in.read((char*) &entry_, sizeof(int32_t));
+  M0_ = 2 * M_;
+  normalize(matrix, n);
+  levels_.resize(n_);
+  in.read((char*) levels_.data(), n_ * sizeof(int32_t));
+  links0_.resize(n_ * (M0_ + 1));
+  in.read((char*) links0_.data(), links0_.size() * sizeof(int32_t));
+  upper_.assign(n_, std::vector<int32_t>());
+  for (int64_t i = 0; i < n_; i++) {
+    upper_[i].resize(levels_[i] * (M_ + 1));
+    in.read((char*) upper_[i].data(), upper_[i].size() * sizeof(int32_t));
+  }
+  building_ = false;
+}
+
+}
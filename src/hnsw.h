@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_HNSW_H
+#define FASTTEXT_HNSW_H
+
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+/**
+ * Hierarchical navigable small world graph over the first rows of a matrix,
+ * for approximate cosine nearest neighbours. The index keeps L2 normalized
+ * copies of the rows; only the graph is saved, so loading needs the matrix
+ * it was built from. A query explores ef candidates on the bottom layer:
+ * larger ef gives better recall and slower queries.
+ */
+class HnswIndex {
+  public:
+    HnswIndex();
+    ~HnswIndex();
+
+    // M links per node and layer (2M on the bottom one)
+    void build(const Matrix&, int64_t, int32_t M, int32_t efConstruction,
+               int32_t threads, int32_t seed);
+    void save(std::ostream&) const;
+    void load(std::istream&, const Matrix&, int64_t);
+
+    int64_t size() const;
+    // normalized row i
+    const real* vector(int32_t) const;
+    // the k nearest rows to query by cosine, most similar first
+    void search(const real*, int32_t k, int32_t ef,
+                std::vector<std::pair<real, int32_t>>&) const;
+
+  private:
+    typedef std::pair<real, int32_t> Candidate;
+    struct Visited;
+
+    static const int32_t NLOCKS = 1 << 16;
+    static const int32_t MAGIC = 0x484e5357;
+
+    int64_t n_;
+    int32_t dim_;
+    int32_t M_;
+    int32_t M0_;
+    int32_t efConstruction_;
+    int32_t entry_;
+    int32_t maxLevel_;
+    bool building_;
+    std::vector<real> data_;
+    std::vector<int32_t> levels_;
+    // per node and layer: the number of links, then room for M (2M) links
+    std::vector<int32_t> links0_;
+    std::vector<std::vector<int32_t>> upper_;
+    std::unique_ptr<std::mutex[]> locks_;
+    std::mutex entryMutex_;
+    mutable std::mutex visitedMutex_;
+    mutable std::vector<std::unique_ptr<Visited>> visited_;
+
+    void normalize(const Matrix&, int64_t);
+    real distance(const real*, int32_t) const;
+    int32_t* links(int32_t, int32_t);
+    const int32_t* links(int32_t, int32_t) const;
+    void neighbors(int32_t, int32_t, std::vector<int32_t>&) const;
+    int32_t greedy(const real*, int32_t, int32_t, int32_t) const;
+    void searchLayer(const real*, int32_t, int32_t, int32_t, Visited&,
+                     std::vector<Candidate>&) const;
+    void select(std::vector<Candidate>&, int32_t) const;
+    void connect(int32_t, int32_t, const std::vector<Candidate>&);
+    void insert(int32_t, Visited&);
+    std::unique_ptr<Visited> acquire() const;
+    void release(std::unique_ptr<Visited>) const;
+};
+
+}
+
+#endif
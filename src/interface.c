@@ -4,6 +4,11 @@
 
 using namespace fasttext;
 
+// return codes of the batch calls
+#define FT_OK 0
+#define FT_NO_MODEL -1
+#define FT_BAD_ARGUMENT -2
+
 extern "C" {
 DocSim* init(char* path) {
   DocSim* pairText = new DocSim();
@@ -43,6 +48,65 @@ real secondSimilarity(DocSim* model, char* first, char* second) {
 }
 
 
+// caches the vectors of up to entries texts, 0 turns caching off
+int setCacheSize(DocSim* model, long entries) {
+  if (model == 0) return FT_NO_MODEL;
+  if (entries < 0) return FT_BAD_ARGUMENT;
+  model->setCacheSize(entries);
+  return FT_OK;
+}
+
+// true when one of the n texts is missing
+static bool missingText(const char* const* texts, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (texts[i] == 0) return true;
+  }
+  return false;
+}
+
+// number of threads the batch calls run on, 1 for the calling thread only
+int setThreads(DocSim* model, int threads) {
+  if (model == 0) return FT_NO_MODEL;
+  if (threads < 1) return FT_BAD_ARGUMENT;
+  model->setThreads(threads);
+  return FT_OK;
+}
+
+// size of the vectors written by getVectorBatch
+int getDimension(DocSim* model) {
+  if (model == 0) return FT_NO_MODEL;
+  return model->getDimension();
+}
+
+// scores[i] = predictProb(firsts[i], seconds[i]); texts need no terminating
+// zero, their sizes are given in bytes
+int predictProbBatch(DocSim* model,
+                     const char* const* firsts, const size_t* firstSizes,
+                     const char* const* seconds, const size_t* secondSizes,
+                     size_t n, real* scores) {
+  if (model == 0) return FT_NO_MODEL;
+  if (n == 0) return FT_OK;
+  if (firsts == 0 || firstSizes == 0 || seconds == 0 || secondSizes == 0 ||
+      scores == 0 || missingText(firsts, n) || missingText(seconds, n)) {
+    return FT_BAD_ARGUMENT;
+  }
+  model->predictProbabilities(firsts, firstSizes, seconds, secondSizes, n,
+                              scores);
+  return FT_OK;
+}
+
+// vectors holds n * getDimension() values, one row per text
+int getVectorBatch(DocSim* model, const char* const* texts,
+                   const size_t* sizes, size_t n, real* vectors) {
+  if (model == 0) return FT_NO_MODEL;
+  if (n == 0) return FT_OK;
+  if (texts == 0 || sizes == 0 || vectors == 0 || missingText(texts, n)) {
+    return FT_BAD_ARGUMENT;
+  }
+  model->getVectors(texts, sizes, n, vectors);
+  return FT_OK;
+}
+
 void destroy(DocSim* model) {
   if (model != 0) {
     delete model;
@@ -0,0 +1,218 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ivf.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "knn.h"
+
+namespace fasttext {
+
+LabelIndex::LabelIndex() : n_(0), dim_(0), nlist_(0) {}
+
+int32_t LabelIndex::nlist() const {
+  return nlist_;
+}
+
+void LabelIndex::build(const Matrix& matrix, int32_t nlist,
+                       int32_t iterations, int32_t threads, int32_t seed) {
+  n_ = matrix.m_;
+  dim_ = matrix.n_;
+  nlist_ = std::max(std::min(nlist, n_), 1);
+  std::minstd_rand rng(seed);
+  std::vector<int32_t> assignment(n_);
+  for (int32_t i = 0; i < n_; i++) {
+    assignment[i] = i;
+  }
+  std::shuffle(assignment.begin(), assignment.end(), rng);
+  centroids_.assign(int64_t(nlist_) * dim_, 0.0);
+  for (int32_t c = 0; c < nlist_ && c < n_; c++) {
+    matrix.touchRow(assignment[c]);
+    memcpy(&centroids_[int64_t(c) * dim_],
+           matrix.data_ + int64_t(assignment[c]) * dim_, dim_ * sizeof(real));
+  }
+  std::vector<real> halfNorms(nlist_);
+  std::vector<int32_t> counts(nlist_);
+  for (int32_t it = 0; it <= iterations; it++) {
+    // the closest centroid in L2 has the largest x.c - |c|^2 / 2
+    for (int32_t c = 0; c < nlist_; c++) {
+      const real* centroid = &centroids_[int64_t(c) * dim_];
+      halfNorms[c] = dotProduct(centroid, centroid, dim_) / 2;
+    }
+    std::atomic<int32_t> next(0);
+    std::vector<std::thread> workers;
+    for (int32_t t = 0; t < std::max(threads, 1); t++) {
+      workers.push_back(std::thread([&]() {
+        for (int32_t i = next++; i < n_; i = next++) {
+          matrix.touchRow(i);
+          const real* row = matrix.data_ + int64_t(i) * dim_;
+          real best = 0.0;
+          for (int32_t c = 0; c < nlist_; c++) {
+            real score = dotProduct(row, &centroids_[int64_t(c) * dim_],
+                                    dim_) - halfNorms[c];
+            if (c == 0 || score > best) {
+              best = score;
+              assignment[i] = c;
+            }
+          }
+        }
+      }));
+    }
+    for (auto w = workers.begin(); w != workers.end(); ++w) {
+      w->join();
+    }
+    if (it == iterations) {
+      break;
+    }
+    std::fill(centroids_.begin(), centroids_.end(), 0.0);
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int32_t i = 0; i < n_; i++) {
+      real* centroid = &centroids_[int64_t(assignment[i]) * dim_];
+      const real* row = matrix.data_ + int64_t(i) * dim_;
+      for (int32_t j = 0; j < dim_; j++) {
+        centroid[j] += row[j];
+      }
+      counts[assignment[i]]++;
+    }
+    std::uniform_int_distribution<int32_t> uniform(0, n_ - 1);
+    for (int32_t c = 0; c < nlist_; c++) {
+      real* centroid = &centroids_[int64_t(c) * dim_];
+      if (counts[c] == 0) {
+        // an empty list restarts from a random label
+        memcpy(centroid, matrix.data_ + int64_t(uniform(rng)) * dim_,
+               dim_ * sizeof(real));
+        continue;
+      }
+      for (int32_t j = 0; j < dim_; j++) {
+        centroid[j] /= counts[c];
+      }
+    }
+  }
+  gather(matrix, assignment);
+}
+
+// sorts the labels by list and copies their rows
+void LabelIndex::gather(const Matrix& matrix,
+                        const std::vector<int32_t>& assignment) {
+  offsets_.assign(nlist_ + 1, 0);
+  for (int32_t i = 0; i < n_; i++) {
+    offsets_[assignment[i] + 1]++;
+  }
+  for (int32_t c = 0; c < nlist_; c++) {
+    offsets_[c + 1] += offsets_[c];
+  }
+  std::vector<int32_t> position(offsets_.begin(), offsets_.end() - 1);
+  ids_.resize(n_);
+  for (int32_t i = 0; i < n_; i++) {
+    ids_[position[assignment[i]]++] = i;
+  }
+  copyRows(matrix);
+}
+
+void LabelIndex::copyRows(const Matrix& matrix) {
+  rows_.resize(int64_t(n_) * dim_);
+  for (int32_t i = 0; i < n_; i++) {
+    matrix.touchRow(ids_[i]);
+    memcpy(&rows_[int64_t(i) * dim_], matrix.data_ + int64_t(ids_[i]) * dim_,
+           dim_ * sizeof(real));
+  }
+}
+
+void LabelIndex::search(const Vector& hidden, int32_t k, int32_t nprobe,
+                        std::vector<std::pair<real, int32_t>>& heap,
+                        std::vector<std::pair<real, int32_t>>& probes) const {
+  heap.clear();
+  if (n_ == 0 || k <= 0) {
+    return;
+  }
+  const real* query = hidden.data_;
+  probes.clear();
+  for (int32_t c = 0; c < nlist_; c++) {
+    probes.push_back(std::make_pair(
+        dotProduct(query, &centroids_[int64_t(c) * dim_], dim_), c));
+  }
+  nprobe = std::max(std::min(nprobe, nlist_), 1);
+  std::greater<std::pair<real, int32_t>> worse;
+  std::nth_element(probes.begin(), probes.begin() + nprobe - 1, probes.end(),
+                   worse);
+  // log of the normalizer, accumulated as max + log(z)
+  real max = probes[0].first, z = 0.0;
+  auto accumulate = [&max, &z](real logit, real weight) {
+    if (logit > max) {
+      z = z * exp(max - logit) + weight;
+      max = logit;
+    } else {
+      z += weight * exp(logit - max);
+    }
+  };
+  for (int32_t p = 0; p < nprobe; p++) {
+    int32_t c = probes[p].second;
+    for (int32_t i = offsets_[c]; i < offsets_[c + 1]; i++) {
+      real logit = dotProduct(query, &rows_[int64_t(i) * dim_], dim_);
+      accumulate(logit, 1.0);
+      if (heap.size() < size_t(k)) {
+        heap.push_back(std::make_pair(logit, ids_[i]));
+        std::push_heap(heap.begin(), heap.end(), worse);
+      } else if (logit > heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), worse);
+        heap.back() = std::make_pair(logit, ids_[i]);
+        std::push_heap(heap.begin(), heap.end(), worse);
+      }
+    }
+  }
+  for (int32_t p = nprobe; p < nlist_; p++) {
+    int32_t c = probes[p].second;
+    accumulate(probes[p].first, offsets_[c + 1] - offsets_[c]);
+  }
+  real lse = max + log(z);
+  for (auto it = heap.begin(); it != heap.end(); ++it) {
+    it->first -= lse;
+  }
+}
+
+void LabelIndex::save(std::ostream& out) const {
+  int32_t magic = MAGIC;
+  out.write((char*) &magic, sizeof(int32_t));
+  out.write((char*) &n_, sizeof(int32_t));
+  out.write((char*) &dim_, sizeof(int32_t));
+  out.write((char*) &nlist_, sizeof(int32_t));
+  out.write((char*) centroids_.data(), centroids_.size() * sizeof(real));
+  out.write((char*) offsets_.data(), offsets_.size() * sizeof(int32_t));
+  out.write((char*) ids_.data(), ids_.size() * sizeof(int32_t));
+}
+
+void LabelIndex::load(std::istream& in, const Matrix& matrix) {
+  int32_t magic;
+  in.read((char*) &magic, sizeof(int32_t));
+  in.read((char*) &n_, sizeof(int32_t));
+  in.read((char*) &dim_, sizeof(int32_t));
+  in.read((char*) &nlist_, sizeof(int32_t));
+  if (!in || magic != MAGIC || n_ != matrix.m_ || dim_ != matrix.n_) {
+    std::cerr << "Label index does not match the model!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  centroids_.resize(int64_t(nlist_) * dim_);
+  in.read((char*) centroids_.data(), centroids_.size() * sizeof(real));
+  offsets_.resize(nlist_ + 1);
+  in.read((char*) offsets_.data(), offsets_.size() * sizeof(int32_t));
+  ids_.resize(n_);
+  in.read((char*) ids_.data(), ids_.size() * sizeof(int32_t));
+  copyRows(matrix);
+}
+
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_IVF_H
+#define FASTTEXT_IVF_H
+
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+/**
+ * Inverted file over the label rows of an output matrix, for the labels with
+ * the largest logits without scoring all of them. The rows are clustered by
+ * k-means and copied list by list; a query scores the centroids, then scans
+ * the rows of the nprobe best lists exactly. The softmax normalizer counts
+ * every other list as its size times the exponential of its centroid logit.
+ * Only the clustering is saved, the rows are copied from the model at load.
+ */
+class LabelIndex {
+  public:
+    LabelIndex();
+
+    void build(const Matrix&, int32_t nlist, int32_t iterations,
+               int32_t threads, int32_t seed);
+    void save(std::ostream&) const;
+    void load(std::istream&, const Matrix&);
+
+    int32_t nlist() const;
+    // the k labels with the largest logits among the probed lists, with
+    // approximate log-probabilities; probes is scratch
+    void search(const Vector&, int32_t k, int32_t nprobe,
+                std::vector<std::pair<real, int32_t>>&,
+                std::vector<std::pair<real, int32_t>>& probes) const;
+
+  private:
+    static const int32_t MAGIC = 0x49564649;
+
+    int32_t n_;
+    int32_t dim_;
+    int32_t nlist_;
+    std::vector<real> centroids_;
+    // list i holds the labels ids_[offsets_[i]] .. ids_[offsets_[i + 1] - 1]
+    std::vector<int32_t> offsets_;
+    std::vector<int32_t> ids_;
+    // their rows, in the same order
+    std::vector<real> rows_;
+
+    void gather(const Matrix&, const std::vector<int32_t>&);
+    void copyRows(const Matrix&);
+};
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "knn.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace fasttext {
+
+void normalizeRows(const Matrix& matrix, int64_t n, std::vector<real>& out) {
+  int64_t dim = matrix.n_;
+  out.resize(n * dim);
+  for (int64_t i = 0; i < n; i++) {
+    matrix.touchRow(i);
+    const real* row = matrix.data_ + i * dim;
+    real* normalized = out.data() + i * dim;
+    double norm = 0.0;
+    for (int64_t j = 0; j < dim; j++) {
+      norm += row[j] * row[j];
+    }
+    real scale = norm > 0.0 ? 1.0 / sqrt(norm) : 0.0;
+    for (int64_t j = 0; j < dim; j++) {
+      normalized[j] = row[j] * scale;
+    }
+  }
+}
+
+real dotProduct(const real* x, const real* y, int32_t n) {
+  const int32_t lanes = 8;
+  int32_t aligned = n - n % lanes;
+  real partial[lanes];
+  for (int32_t l = 0; l < lanes; l++) {
+    partial[l] = 0.0;
+  }
+  for (int32_t j = 0; j < aligned; j += lanes) {
+    for (int32_t l = 0; l < lanes; l++) {
+      partial[l] += x[j + l] * y[j + l];
+    }
+  }
+  real sum = 0.0;
+  for (int32_t j = aligned; j < n; j++) {
+    sum += x[j] * y[j];
+  }
+  for (int32_t l = 0; l < lanes; l++) {
+    sum += partial[l];
+  }
+  return sum;
+}
+
+// keeps the k best neighbours in a min-heap on the similarity
+static inline void offer(std::vector<ExactIndex::Neighbor>& heap, int32_t k,
+                         real score, int32_t i) {
+  std::greater<ExactIndex::Neighbor> worse;
+  if (heap.size() < size_t(k)) {
+    heap.push_back(std::make_pair(score, i));
+    std::push_heap(heap.begin(), heap.end(), worse);
+  } else if (score > heap.front().first) {
+    std::pop_heap(heap.begin(), heap.end(), worse);
+    heap.back() = std::make_pair(score, i);
+    std::push_heap(heap.begin(), heap.end(), worse);
+  }
+}
+
+ExactIndex::ExactIndex() : n_(0), dim_(0) {}
+
+void ExactIndex::build(const Matrix& matrix, int64_t n) {
+  n_ = n;
+  dim_ = matrix.n_;
+  normalizeRows(matrix, n, data_);
+}
+
+int64_t ExactIndex::size() const {
+  return n_;
+}
+
+const real* ExactIndex::vector(int32_t i) const {
+  return data_.data() + int64_t(i) * dim_;
+}
+
+// block holds QUERY_BLOCK queries interleaved: coordinate j of query q is
+// at j * QUERY_BLOCK + q, so the inner loop runs over the queries and is
+// vectorized without reordering the sums
+void ExactIndex::scoreBlock(const real* block, int64_t begin, int64_t end,
+                            int32_t k, std::vector<Neighbor>* heaps) const {
+  real scores[QUERY_BLOCK];
+  for (int64_t i = begin; i < end; i++) {
+    const real* row = data_.data() + i * dim_;
+    for (int32_t q = 0; q < QUERY_BLOCK; q++) {
+      scores[q] = 0.0;
+    }
+    for (int32_t j = 0; j < dim_; j++) {
+      const real* lanes = block + j * QUERY_BLOCK;
+      real x = row[j];
+      for (int32_t q = 0; q < QUERY_BLOCK; q++) {
+        scores[q] += lanes[q] * x;
+      }
+    }
+    for (int32_t q = 0; q < QUERY_BLOCK; q++) {
+      offer(heaps[q], k, scores[q], i);
+    }
+  }
+}
+
+// a query left over from the blocks
+void ExactIndex::scoreOne(const real* query, int64_t begin, int64_t end,
+                          int32_t k, std::vector<Neighbor>& heap) const {
+  for (int64_t i = begin; i < end; i++) {
+    offer(heap, k, dotProduct(query, data_.data() + i * dim_, dim_), i);
+  }
+}
+
+void ExactIndex::search(const real* queries, int32_t nq, int32_t k,
+                        std::vector<std::vector<Neighbor>>& out) const {
+  if (out.size() < size_t(nq)) {
+    out.resize(nq);
+  }
+  for (int32_t q = 0; q < nq; q++) {
+    out[q].clear();
+  }
+  if (k <= 0) {
+    return;
+  }
+  int32_t nblocks = nq / QUERY_BLOCK;
+  std::vector<real> blocks(int64_t(nblocks) * QUERY_BLOCK * dim_);
+  for (int32_t q = 0; q < nblocks * QUERY_BLOCK; q++) {
+    real* block = blocks.data() + int64_t(q / QUERY_BLOCK) * QUERY_BLOCK * dim_;
+    const real* query = queries + int64_t(q) * dim_;
+    for (int32_t j = 0; j < dim_; j++) {
+      block[j * QUERY_BLOCK + q % QUERY_BLOCK] = query[j];
+    }
+  }
+  for (int64_t begin = 0; begin < n_; begin += ROW_BLOCK) {
+    int64_t end = std::min(begin + ROW_BLOCK, n_);
+    for (int32_t b = 0; b < nblocks; b++) {
+      scoreBlock(blocks.data() + int64_t(b) * QUERY_BLOCK * dim_, begin, end,
+                 k, out.data() + b * QUERY_BLOCK);
+    }
+    for (int32_t q = nblocks * QUERY_BLOCK; q < nq; q++) {
+      scoreOne(queries + int64_t(q) * dim_, begin, end, k, out[q]);
+    }
+  }
+  std::greater<Neighbor> worse;
+  for (int32_t q = 0; q < nq; q++) {
+    std::sort_heap(out[q].begin(), out[q].end(), worse);
+  }
+}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_KNN_H
+#define FASTTEXT_KNN_H
+
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+// L2 normalized copies of the first n rows of matrix; zero rows stay zero
+void normalizeRows(const Matrix&, int64_t, std::vector<real>&);
+// with partial sums the compiler can vectorize
+real dotProduct(const real*, const real*, int32_t);
+
+/**
+ * Exact cosine nearest neighbours over the first rows of a matrix. The rows
+ * are normalized once, so scoring is a dot product. Queries are scored in
+ * blocks of QUERY_BLOCK against tiles of ROW_BLOCK rows, each row is loaded
+ * once per query block and each tile stays in cache across the blocks. A
+ * bounded heap per query keeps the best k rows.
+ */
+class ExactIndex {
+  public:
+    // similarity, row
+    typedef std::pair<real, int32_t> Neighbor;
+
+    ExactIndex();
+
+    void build(const Matrix&, int64_t);
+
+    int64_t size() const;
+    // normalized row i
+    const real* vector(int32_t) const;
+    // the k rows most similar to each of nq normalized queries stored one
+    // after the other, most similar first
+    void search(const real*, int32_t nq, int32_t k,
+                std::vector<std::vector<Neighbor>>&) const;
+
+  private:
+    static const int32_t QUERY_BLOCK = 32;
+    static const int64_t ROW_BLOCK = 512;
+
+    int64_t n_;
+    int32_t dim_;
+    std::vector<real> data_;
+
+    void scoreBlock(const real*, int64_t, int64_t, int32_t,
+                    std::vector<Neighbor>*) const;
+    void scoreOne(const real*, int64_t, int64_t, int32_t,
+                  std::vector<Neighbor>&) const;
+};
+
+}
+
+#endif
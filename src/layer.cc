@@ -7,19 +7,32 @@
 
 namespace fasttext {
 
-AverageLayer::AverageLayer(std::shared_ptr<Matrix> embedding): embedding_(embedding) {}
+AverageLayer::AverageLayer(std::shared_ptr<Matrix> embedding, int32_t prefetch)
+  : embedding_(embedding), prefetch_(prefetch) {}
 
 void AverageLayer::compute(const std::vector<int32_t>& input, Vector& output) const {
   output.zero();
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    output.addRow(*embedding_, *it);
+  for (int32_t i = 0; i < prefetch_ && i < input.size(); i++) {
+    embedding_->prefetchRow(input[i]);
+  }
+  for (size_t i = 0; i < input.size(); i++) {
+    if (prefetch_ > 0 && i + prefetch_ < input.size()) {
+      embedding_->prefetchRow(input[i + prefetch_]);
+    }
+    output.addRow(*embedding_, input[i]);
   }
   output.mul(1.0 / input.size());
 }
 
 void AverageLayer::update(const std::vector<int32_t>& input, const Vector& outputGrad) {
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    embedding_->addRow(outputGrad, *it, 1.0 / input.size());
+  for (int32_t i = 0; i < prefetch_ && i < input.size(); i++) {
+    embedding_->prefetchRow(input[i], true);
+  }
+  for (size_t i = 0; i < input.size(); i++) {
+    if (prefetch_ > 0 && i + prefetch_ < input.size()) {
+      embedding_->prefetchRow(input[i + prefetch_], true);
+    }
+    embedding_->addRow(outputGrad, input[i], 1.0 / input.size());
   }
 }
 
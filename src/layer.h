@@ -13,8 +13,9 @@ namespace fasttext{
 class AverageLayer {
 private:
   std::shared_ptr<Matrix> embedding_;
+  int32_t prefetch_;
 public:
-  AverageLayer(std::shared_ptr<Matrix> embedding);
+  AverageLayer(std::shared_ptr<Matrix> embedding, int32_t prefetch = 0);
   void compute(const std::vector<int32_t>& input, Vector& output) const;
   void update(const std::vector<int32_t>& input, const Vector& outputGrad);
 };
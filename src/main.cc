@@ -7,10 +7,15 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 #include "fasttext.h"
 #include "args.h"
+#include "docsim.h"
+#include "pairtext.h"
+#include "server.h"
 
 using namespace fasttext;
 
@@ -25,24 +30,90 @@ void printUsage() {
     << "  skipgram            train a skipgram model\n"
     << "  cbow                train a cbow model\n"
     << "  print-vectors       print vectors given a trained model\n"
+    << "  nbest               print the nearest neighbours of words\n"
+    << "  nbest-all           print the nearest neighbours of every word\n"
+    << "  build-index         build a nearest neighbour index of the word vectors\n"
+    << "  build-label-index   build an index of the labels for faster predictions\n"
+    << "  serve               answer predictions on a socket\n"
     << std::endl;
 }
 
 void printTestUsage() {
   std::cout
-    << "usage: fasttext test <model> <test-data> [<k>]\n\n"
+    << "usage: fasttext test <model> <test-data> [<k>] [<threads>]\n\n"
     << "  <model>      model filename\n"
     << "  <test-data>  test data filename (if -, read from stdin)\n"
     << "  <k>          (optional; 1 by default) predict top k labels\n"
+    << "  <threads>    (optional; all cores by default) number of threads\n"
     << std::endl;
 }
 
 void printPredictUsage() {
   std::cout
-    << "usage: fasttext predict[-prob] <model> <test-data> [<k>]\n\n"
+    << "usage: fasttext predict[-prob] <model> <test-data> [<k>] [<threads>]\n\n"
     << "  <model>      model filename\n"
     << "  <test-data>  test data filename (if -, read from stdin)\n"
     << "  <k>          (optional; 1 by default) predict top k labels\n"
+    << "  <threads>    (optional; all cores by default) number of threads\n"
+    << std::endl;
+}
+
+void printNbestUsage() {
+  std::cout
+    << "usage: fasttext nbest <model> [<index>] [<ef>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <index>      (optional) index from build-index, exact search without\n"
+    << "  <ef>         (optional; 64 by default) candidates explored per query\n\n"
+    << "Reads \"<word> <n>\" queries from stdin and prints the n nearest words.\n"
+    << std::endl;
+}
+
+void printNbestAllUsage() {
+  std::cout
+    << "usage: fasttext nbest-all <model> [<k>] [<threads>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <k>          (optional; 10 by default) neighbours per word\n"
+    << "  <threads>    (optional; all cores by default) number of threads\n\n"
+    << "Prints one line per word: the word, then k neighbours and similarities.\n"
+    << std::endl;
+}
+
+void printBuildLabelIndexUsage() {
+  std::cout
+    << "usage: fasttext build-label-index <model> <index> [<nlist>] [<threads>]\n\n"
+    << "  <model>      supervised softmax or ns model filename\n"
+    << "  <index>      index filename to write\n"
+    << "  <nlist>      (optional; square root of the labels by default) label clusters\n"
+    << "  <threads>    (optional; all cores by default) number of threads\n\n"
+    << "test, predict and serve use the index named by FASTTEXT_LABEL_INDEX and\n"
+    << "scan the FASTTEXT_NPROBE (16 by default) clusters closest to each text.\n"
+    << std::endl;
+}
+
+void printBuildIndexUsage() {
+  std::cout
+    << "usage: fasttext build-index <model> <index> [<M>] [<ef>] [<threads>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <index>      index filename to write\n"
+    << "  <M>          (optional; 16 by default) links per node\n"
+    << "  <ef>         (optional; 200 by default) candidates explored per insert\n"
+    << "  <threads>    (optional; all cores by default) number of threads\n"
+    << std::endl;
+}
+
+void printServeUsage() {
+  std::cout
+    << "usage: fasttext serve <type> <model> <address> [<k>] [<threads>]\n\n"
+    << "  <type>       fasttext, pairtext or docsim\n"
+    << "  <model>      model filename\n"
+    << "  <address>    unix:<path> or <host>:<port>\n"
+    << "  <k>          (optional; 1 by default) labels per fasttext request\n"
+    << "  <threads>    (optional; all cores by default) number of workers\n\n"
+    << "A fasttext request is a line of text and is answered with its labels\n"
+    << "and probabilities; a pairtext or docsim request is two lines and is\n"
+    << "answered with their score. /stats reports QPS and latencies.\n"
+    << "FASTTEXT_CACHE_SIZE sets how many pairtext or docsim text vectors\n"
+    << "are cached.\n"
     << std::endl;
 }
 
@@ -53,57 +124,90 @@ void printPrintVectorsUsage() {
     << std::endl;
 }
 
+// commands without options read the huge page mode of -hugePages from
+// FASTTEXT_HUGE_PAGES
+void setHugePages() {
+  const char* mode = getenv("FASTTEXT_HUGE_PAGES");
+  if (mode != nullptr) {
+    Matrix::hugePages = atoi(mode);
+  }
+}
+
+// prediction commands read the -beam width of hs models from FASTTEXT_BEAM,
+// and a label index from FASTTEXT_LABEL_INDEX, probing FASTTEXT_NPROBE lists
+void setPredictOptions(FastText& fasttext) {
+  const char* beam = getenv("FASTTEXT_BEAM");
+  if (beam != nullptr) {
+    fasttext.setBeam(atoi(beam));
+  }
+  const char* index = getenv("FASTTEXT_LABEL_INDEX");
+  if (index != nullptr) {
+    const char* nprobe = getenv("FASTTEXT_NPROBE");
+    fasttext.loadLabelIndex(index, nprobe != nullptr ? atoi(nprobe) : 16);
+  }
+}
+
 void test(int argc, char** argv) {
-  int32_t k;
-  if (argc == 4) {
-    k = 1;
-  } else if (argc == 5) {
+  int32_t k = 1;
+  int32_t threads = std::thread::hardware_concurrency();
+  if (argc >= 5 && argc <= 6) {
     k = atoi(argv[4]);
-  } else {
+  }
+  if (argc == 6) {
+    threads = atoi(argv[5]);
+  }
+  if (argc < 4 || argc > 6) {
     printTestUsage();
     exit(EXIT_FAILURE);
   }
+  setHugePages();
   FastText fasttext;
   fasttext.loadModel(std::string(argv[2]));
+  setPredictOptions(fasttext);
   std::string infile(argv[3]);
   if (infile == "-") {
-    fasttext.test(std::cin, k);
+    fasttext.test(std::cin, k, threads);
   } else {
     std::ifstream ifs(infile);
     if (!ifs.is_open()) {
       std::cerr << "Test file cannot be opened!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    fasttext.test(ifs, k);
+    fasttext.test(ifs, k, threads);
     ifs.close();
   }
   exit(0);
 }
 
 void predict(int argc, char** argv) {
-  int32_t k;
-  if (argc == 4) {
-    k = 1;
-  } else if (argc == 5) {
+  int32_t k = 1;
+  int32_t threads = std::thread::hardware_concurrency();
+  if (argc >= 5 && argc <= 6) {
     k = atoi(argv[4]);
-  } else {
+  }
+  if (argc == 6) {
+    threads = atoi(argv[5]);
+  }
+  if (argc < 4 || argc > 6) {
     printPredictUsage();
     exit(EXIT_FAILURE);
   }
   bool print_prob = std::string(argv[1]) == "predict-prob";
+  setHugePages();
   FastText fasttext;
   fasttext.loadModel(std::string(argv[2]));
+  setPredictOptions(fasttext);
 
   std::string infile(argv[3]);
   if (infile == "-") {
-    fasttext.predict(std::cin, k, print_prob);
+    fasttext.predict(std::cin, k, print_prob, threads);
   } else {
     std::ifstream ifs(infile);
     if (!ifs.is_open()) {
       std::cerr << "Input file cannot be opened!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    fasttext.predict(ifs, k, print_prob);
+    fasttext.predict(ifs, k, print_prob, threads);
     ifs.close();
   }
 
@@ -111,22 +215,153 @@ void predict(int argc, char** argv) {
 }
 
 void nbest(int argc, char** argv) {
+  if (argc < 3 || argc > 5) {
+    printNbestUsage();
+    exit(EXIT_FAILURE);
+  }
+  setHugePages();
+  FastText fasttext;
+  fasttext.loadModel(std::string(argv[2]));
+  if (argc >= 4) {
+    fasttext.loadIndex(std::string(argv[3]));
+  }
+  fasttext.nbest(argc == 5 ? atoi(argv[4]) : 64);
+  exit(0);
+}
+
+void nbestAll(int argc, char** argv) {
+  if (argc < 3 || argc > 5) {
+    printNbestAllUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t k = argc >= 4 ? atoi(argv[3]) : 10;
+  int32_t threads = argc == 5 ? atoi(argv[4])
+                              : std::thread::hardware_concurrency();
+  setHugePages();
+  FastText fasttext;
+  fasttext.loadModel(std::string(argv[2]));
+  fasttext.allNeighbors(k, threads);
+  exit(0);
+}
+
+void buildIndex(int argc, char** argv) {
+  if (argc < 4 || argc > 7) {
+    printBuildIndexUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t M = argc >= 5 ? atoi(argv[4]) : 16;
+  int32_t efConstruction = argc >= 6 ? atoi(argv[5]) : 200;
+  int32_t threads = argc == 7 ? atoi(argv[6])
+                              : std::thread::hardware_concurrency();
+  setHugePages();
+  FastText fasttext;
+  fasttext.loadModel(std::string(argv[2]));
+  fasttext.buildIndex(std::string(argv[3]), M, efConstruction, threads);
+  exit(0);
+}
+
+void buildLabelIndex(int argc, char** argv) {
+  if (argc < 4 || argc > 6) {
+    printBuildLabelIndexUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t threads = argc == 6 ? atoi(argv[5])
+                              : std::thread::hardware_concurrency();
+  int32_t nlist = argc >= 5 ? atoi(argv[4]) : 0;
+  setHugePages();
   FastText fasttext;
   fasttext.loadModel(std::string(argv[2]));
-  fasttext.nbest();
+  fasttext.buildLabelIndex(std::string(argv[3]), nlist, threads);
   exit(0);
 }
+
 void printVectors(int argc, char** argv) {
   if (argc != 3) {
     printPrintVectorsUsage();
     exit(EXIT_FAILURE);
   }
+  setHugePages();
   FastText fasttext;
   fasttext.loadModel(std::string(argv[2]));
   fasttext.printVectors();
   exit(0);
 }
 
+void serve(int argc, char** argv) {
+  if (argc < 5 || argc > 7) {
+    printServeUsage();
+    exit(EXIT_FAILURE);
+  }
+  std::string type(argv[2]);
+  std::string model(argv[3]);
+  int32_t k = argc >= 6 ? atoi(argv[5]) : 1;
+  int32_t threads = argc == 7 ? atoi(argv[6])
+                              : std::thread::hardware_concurrency();
+  // texts whose vectors pairtext and docsim keep, from FASTTEXT_CACHE_SIZE
+  const char* cache = getenv("FASTTEXT_CACHE_SIZE");
+  size_t cacheSize = cache != nullptr ? strtoull(cache, nullptr, 10) : 0;
+  // fasttext requests a worker scores together, from FASTTEXT_SERVE_BATCH,
+  // and the microseconds it waits for them, from FASTTEXT_SERVE_WAIT
+  const char* batch = getenv("FASTTEXT_SERVE_BATCH");
+  int32_t maxBatch = batch != nullptr ? atoi(batch) : 32;
+  const char* wait = getenv("FASTTEXT_SERVE_WAIT");
+  std::chrono::microseconds maxWait(wait != nullptr ? atoi(wait) : 100);
+  setHugePages();
+  std::shared_ptr<Server> server;
+  if (type == "fasttext") {
+    auto fasttext = std::make_shared<FastText>();
+    fasttext->loadModel(model);
+    setPredictOptions(*fasttext);
+    server = std::make_shared<Server>(1, threads, maxBatch, maxWait,
+        [fasttext](int32_t i) { return fasttext->createSession(i); },
+        [fasttext, k](InferenceSession& session,
+                      std::vector<Server::Request*>& requests) {
+          std::vector<const std::string*> texts;
+          for (auto it = requests.begin(); it != requests.end(); ++it) {
+            texts.push_back(&(*it)->lines[0]);
+          }
+          fasttext->predict(session, texts, k);
+          for (size_t i = 0; i < requests.size(); i++) {
+            requests[i]->response.clear();
+            fasttext->appendPredictions(session.batchPredictions[i], true,
+                                        requests[i]->response);
+          }
+        });
+  } else if (type == "pairtext") {
+    auto pairText = std::make_shared<PairText>();
+    pairText->loadModel(model);
+    pairText->setCacheSize(cacheSize);
+    server = std::make_shared<Server>(2, threads, 1,
+        std::chrono::microseconds(0),
+        [pairText](int32_t i) { return pairText->createSession(i); },
+        [pairText](InferenceSession& session,
+                   std::vector<Server::Request*>& requests) {
+          Server::Request& request = *requests[0];
+          real prob = pairText->predictProbability(
+              session, request.lines[0], request.lines[1]);
+          request.response = std::to_string(prob);
+        });
+  } else if (type == "docsim") {
+    auto docSim = std::make_shared<DocSim>();
+    docSim->loadModel(model);
+    docSim->setCacheSize(cacheSize);
+    server = std::make_shared<Server>(2, threads, 1,
+        std::chrono::microseconds(0),
+        [docSim](int32_t i) { return docSim->createSession(i); },
+        [docSim](InferenceSession& session,
+                 std::vector<Server::Request*>& requests) {
+          Server::Request& request = *requests[0];
+          real sim = docSim->predictProbability(
+              session, request.lines[0], request.lines[1]);
+          request.response = std::to_string(sim);
+        });
+  } else {
+    printServeUsage();
+    exit(EXIT_FAILURE);
+  }
+  server->serve(std::string(argv[4]));
+}
+
 void train(int argc, char** argv) {
   std::shared_ptr<Args> a = std::make_shared<Args>();
   a->parseArgs(argc, argv);
@@ -150,6 +385,14 @@ int main(int argc, char** argv) {
     predict(argc, argv);
   } else if (command == "nbest") {
     nbest(argc, argv);
+  } else if (command == "nbest-all") {
+    nbestAll(argc, argv);
+  } else if (command == "build-index") {
+    buildIndex(argc, argv);
+  } else if (command == "build-label-index") {
+    buildLabelIndex(argc, argv);
+  } else if (command == "serve") {
+    serve(argc, argv);
   } else {
     printUsage();
     exit(EXIT_FAILURE);
@@ -10,33 +10,47 @@
 #include "matrix.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <sys/mman.h>
 
+#include <cstring>
+#include <iostream>
 #include <random>
+#include <thread>
+#include <vector>
 
 #include "utils.h"
 #include "vector.h"
 
 namespace fasttext {
 
+int32_t Matrix::hugePages = 0;
+
 Matrix::Matrix() {
   m_ = 0;
   n_ = 0;
   data_ = nullptr;
+  mapped_ = 0;
+  lazyBegin_ = std::numeric_limits<int64_t>::max();
+  lazyBound_ = 0.0;
 }
 
 Matrix::Matrix(int64_t m, int64_t n) {
   m_ = m;
   n_ = n;
-  data_ = new real[m * n];
+  allocate(m * n);
+  lazyBegin_ = std::numeric_limits<int64_t>::max();
+  lazyBound_ = 0.0;
 }
 
+// copies are never lazy
 Matrix::Matrix(const Matrix& other) {
   m_ = other.m_;
   n_ = other.n_;
-  data_ = new real[m_ * n_];
-  for (int64_t i = 0; i < (m_ * n_); i++) {
-    data_[i] = other.data_[i];
-  }
+  allocate(m_ * n_);
+  lazyBegin_ = std::numeric_limits<int64_t>::max();
+  lazyBound_ = 0.0;
+  other.copyTo(*this);
 }
 
 Matrix& Matrix::operator=(const Matrix& other) {
@@ -44,11 +58,74 @@ Matrix& Matrix::operator=(const Matrix& other) {
   m_ = temp.m_;
   n_ = temp.n_;
   std::swap(data_, temp.data_);
+  std::swap(mapped_, temp.mapped_);
+  lazyBegin_ = temp.lazyBegin_;
+  rowState_.reset();
   return *this;
 }
 
 Matrix::~Matrix() {
-  delete[] data_;
+  release();
+}
+
+// Rows are read at random, so big matrices spend much of their time in TLB
+// misses with 4KB pages. Buffers of at least one huge page are mapped on a
+// 2MB boundary and backed by huge pages when the kernel can, and fall back
+// to the heap otherwise.
+void Matrix::allocate(int64_t size) {
+  int64_t bytes = size * sizeof(real);
+  data_ = nullptr;
+  mapped_ = 0;
+#ifdef __linux__
+  if (hugePages > 0 && bytes >= HUGE_PAGE_SIZE) {
+    int64_t length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugePages == 2) {
+      p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED) {
+        std::cerr << "No hugetlbfs pages for a " << bytes
+                  << " byte matrix, using transparent huge pages" << std::endl;
+      }
+    }
+#endif
+    if (p == MAP_FAILED) {
+      // anonymous mappings are only page aligned: map one huge page more
+      // and trim both ends
+      char* q = (char*) mmap(nullptr, length + HUGE_PAGE_SIZE,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (q != MAP_FAILED) {
+        int64_t head = (HUGE_PAGE_SIZE - (uintptr_t) q % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+        if (head > 0) {
+          munmap(q, head);
+        }
+        munmap(q + head + length, HUGE_PAGE_SIZE - head);
+        p = q + head;
+#ifdef MADV_HUGEPAGE
+        madvise(p, length, MADV_HUGEPAGE);
+#endif
+      }
+    }
+    if (p != MAP_FAILED) {
+      data_ = (real*) p;
+      mapped_ = length;
+      return;
+    }
+  }
+#endif
+  data_ = new real[size];
+}
+
+void Matrix::release() {
+  if (mapped_ > 0) {
+    munmap(data_, mapped_);
+  } else {
+    delete[] data_;
+  }
+  data_ = nullptr;
+  mapped_ = 0;
 }
 
 void Matrix::zero() {
@@ -65,10 +142,75 @@ void Matrix::uniform(real a) {
   }
 }
 
+// Same as uniform for the rows before begin. The rows after it, e.g. the
+// hashed n-gram buckets, are mostly never used: they are left as untouched
+// pages and each gets values from its own seed when first touched, so the
+// result does not depend on the order rows are reached in.
+void Matrix::lazyUniform(real a, int64_t begin) {
+  assert(begin >= 0 && begin <= m_);
+  std::minstd_rand rng(1);
+  std::uniform_real_distribution<> uniform(-a, a);
+  for (int64_t i = 0; i < (begin * n_); i++) {
+    data_[i] = uniform(rng);
+  }
+  lazyBegin_ = begin;
+  lazyBound_ = a;
+  rowState_.reset(new std::atomic<uint8_t>[m_ - begin]);
+  for (int64_t i = 0; i < m_ - begin; i++) {
+    rowState_[i].store(ROW_EMPTY, std::memory_order_relaxed);
+  }
+}
+
+void Matrix::uniformRow(int64_t i, real* row) const {
+  std::minstd_rand rng(i + 1);
+  std::uniform_real_distribution<> uniform(-lazyBound_, lazyBound_);
+  for (int64_t j = 0; j < n_; j++) {
+    row[j] = uniform(rng);
+  }
+}
+
+void Matrix::initRow(int64_t i) const {
+  std::atomic<uint8_t>& state = rowState_[i - lazyBegin_];
+  uint8_t expected = ROW_EMPTY;
+  if (state.compare_exchange_strong(expected, ROW_BUSY)) {
+    uniformRow(i, data_ + i * n_);
+    state.store(ROW_READY, std::memory_order_release);
+  } else {
+    while (state.load(std::memory_order_acquire) != ROW_READY) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// initializes every lazy row, for code working on the whole buffer
+void Matrix::materialize() {
+  for (int64_t i = lazyBegin_; i < m_; i++) {
+    touchRow(i);
+  }
+  lazyBegin_ = std::numeric_limits<int64_t>::max();
+  rowState_.reset();
+}
+
+// copies the values into a matrix of the same shape, generating the lazy
+// rows not touched yet without initializing them here
+void Matrix::copyTo(Matrix& other) const {
+  assert(other.m_ == m_ && other.n_ == n_);
+  int64_t begin = std::min(lazyBegin_, m_);
+  memcpy(other.data_, data_, begin * n_ * sizeof(real));
+  for (int64_t i = begin; i < m_; i++) {
+    if (rowState_[i - lazyBegin_].load(std::memory_order_acquire) == ROW_READY) {
+      memcpy(other.data_ + i * n_, data_ + i * n_, n_ * sizeof(real));
+    } else {
+      uniformRow(i, other.data_ + i * n_);
+    }
+  }
+}
+
 void Matrix::addRow(const Vector& vec, int64_t i, real a) {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.m_ == n_);
+  touchRow(i);
   for (int64_t j = 0; j < n_; j++) {
     data_[i * n_ + j] += a * vec.data_[j];
   }
@@ -78,6 +220,7 @@ real Matrix::dotRow(const Vector& vec, int64_t i) {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.m_ == n_);
+  touchRow(i);
   real d = 0.0;
   for (int64_t j = 0; j < n_; j++) {
     d += data_[i * n_ + j] * vec.data_[j];
@@ -87,6 +230,7 @@ real Matrix::dotRow(const Vector& vec, int64_t i) {
 
 void Matrix::getRow(const int64_t i, Vector &v) {
   assert(v.m_ == n_);
+  touchRow(i);
   for (int64_t j = 0; j < n_; j++) {
     v.data_[j] = data_[i * n_ + j];
   }
@@ -125,14 +269,29 @@ void Matrix::add(const Vector& x, const Vector& y, real alpha) {
 void Matrix::save(std::ostream& out) {
   out.write((char*) &m_, sizeof(int64_t));
   out.write((char*) &n_, sizeof(int64_t));
-  out.write((char*) data_, m_ * n_ * sizeof(real));
+  if (lazyBegin_ >= m_) {
+    out.write((char*) data_, m_ * n_ * sizeof(real));
+    return;
+  }
+  out.write((char*) data_, lazyBegin_ * n_ * sizeof(real));
+  std::vector<real> row(n_);
+  for (int64_t i = lazyBegin_; i < m_; i++) {
+    const real* src = data_ + i * n_;
+    if (rowState_[i - lazyBegin_].load(std::memory_order_acquire) != ROW_READY) {
+      uniformRow(i, row.data());
+      src = row.data();
+    }
+    out.write((char*) src, n_ * sizeof(real));
+  }
 }
 
 void Matrix::load(std::istream& in) {
   in.read((char*) &m_, sizeof(int64_t));
   in.read((char*) &n_, sizeof(int64_t));
-  delete[] data_;
-  data_ = new real[m_ * n_];
+  release();
+  allocate(m_ * n_);
+  lazyBegin_ = std::numeric_limits<int64_t>::max();
+  rowState_.reset();
   in.read((char*) data_, m_ * n_ * sizeof(real));
 }
 
@@ -10,8 +10,11 @@
 #ifndef FASTTEXT_MATRIX_H
 #define FASTTEXT_MATRIX_H
 
+#include <atomic>
 #include <cstdint>
 #include <istream>
+#include <limits>
+#include <memory>
 #include <ostream>
 
 #include "real.h"
@@ -22,11 +25,35 @@ class Vector;
 
 class Matrix {
 
+  private:
+    // bytes mapped for data_, 0 when it comes from new[]
+    int64_t mapped_;
+
+    void allocate(int64_t);
+    void release();
+
+    // rows from lazyBegin_ on are drawn from uniform(-lazyBound_, lazyBound_)
+    // the first time they are touched, rowState_ tells which ones were
+    int64_t lazyBegin_;
+    real lazyBound_;
+    std::unique_ptr<std::atomic<uint8_t>[]> rowState_;
+
+    static const uint8_t ROW_EMPTY = 0;
+    static const uint8_t ROW_BUSY = 1;
+    static const uint8_t ROW_READY = 2;
+
+    void uniformRow(int64_t, real*) const;
+    void initRow(int64_t) const;
+
   public:
     real* data_;
     int64_t m_;
     int64_t n_;
 
+    // 0: plain heap, 1: 2MB aligned with MADV_HUGEPAGE, 2: MAP_HUGETLB first
+    static int32_t hugePages;
+    static const int64_t HUGE_PAGE_SIZE = 2 << 20;
+
     Matrix();
     Matrix(int64_t, int64_t);
     Matrix(const Matrix&);
@@ -35,12 +62,38 @@ class Matrix {
 
     void zero();
     void uniform(real);
+    void lazyUniform(real, int64_t);
+    void materialize();
+    void copyTo(Matrix&) const;
+
+    // initializes a lazy row before its first use
+    inline void touchRow(int64_t i) const {
+      if (i >= lazyBegin_ &&
+          rowState_[i - lazyBegin_].load(std::memory_order_acquire) != ROW_READY) {
+        initRow(i);
+      }
+    }
     real dotRow(const Vector&, int64_t);
     void addRow(const Vector&, int64_t, real);
     void addMatrix(const Vector& left, const Vector& right);
     void addMatrix(const Matrix& matrix, real alpha);
     void add(const Vector& x, const Vector& y, real alpha);
     void getRow(const int64_t, Vector&);
+
+    // asks the cache for row i ahead of a read, or of a write
+    inline void prefetchRow(int64_t i, bool write = false) const {
+#if defined(__GNUC__)
+      const char* begin = reinterpret_cast<const char*>(data_ + i * n_);
+      const char* end = reinterpret_cast<const char*>(data_ + (i + 1) * n_);
+      for (const char* p = begin; p < end; p += 64) {
+        if (write) {
+          __builtin_prefetch(p, 1, 3);
+        } else {
+          __builtin_prefetch(p, 0, 3);
+        }
+      }
+#endif
+    }
     void save(std::ostream&);
     void load(std::istream&);
 };
@@ -14,6 +14,7 @@
 
 #include <algorithm>
 
+#include "knn.h"
 #include "utils.h"
 
 namespace fasttext {
@@ -31,8 +32,10 @@ Model::Model(std::shared_ptr<Matrix> wi,
   osz_ = wo->m_;
   hsz_ = args->dim;
   negpos = 0;
+  nprobe_ = 0;
   loss_ = 0.0;
   nexamples_ = 1;
+  flushed_ = nexamples_;
   initSigmoid();
   initLog();
 }
@@ -42,11 +45,60 @@ Model::~Model() {
   delete[] t_log;
 }
 
+real Model::dotOutput(int32_t target) {
+  if (outBuf_.contains(target)) {
+    return outBuf_.dotRow(hidden_, target);
+  }
+  return wo_->dotRow(hidden_, target);
+}
+
+void Model::updateOutput(int32_t target, real alpha) {
+  if (outTracker_) {
+    outTracker_->mark(target);
+  }
+  if (outBuf_.contains(target)) {
+    outBuf_.addRowTo(grad_, target, alpha);
+    outBuf_.addRow(hidden_, target, alpha);
+  } else {
+    grad_.addRow(*wo_, target, alpha);
+    wo_->addRow(hidden_, target, alpha);
+  }
+}
+
+// Rows are gathered in random order from matrices far larger than the
+// cache, so each loop requests the row args_->prefetch positions ahead.
+void Model::prefetchInput(const std::vector<int32_t>& input, size_t i,
+                          bool write) const {
+  if (args_->prefetch > 0 && i < input.size() && !inBuf_.contains(input[i])) {
+    wi_->prefetchRow(input[i], write);
+  }
+}
+
+// output rows an update is about to read and write, e.g. a path in the tree
+void Model::prefetchOutput(const std::vector<int32_t>& rows) const {
+  if (args_->prefetch <= 0) return;
+  for (auto it = rows.cbegin(); it != rows.cend(); ++it) {
+    if (!outBuf_.contains(*it)) {
+      wo_->prefetchRow(*it, true);
+    }
+  }
+}
+
+// the next negatives in the table, ahead of getNegative
+void Model::prefetchNegatives() const {
+  if (args_->prefetch <= 0) return;
+  for (int32_t n = 0; n < args_->neg; n++) {
+    int32_t negative = negatives[(negpos + n) % negatives.size()];
+    if (!outBuf_.contains(negative)) {
+      wo_->prefetchRow(negative, true);
+    }
+  }
+}
+
 real Model::binaryLogistic(int32_t target, bool label, real lr) {
-  real score = sigmoid(wo_->dotRow(hidden_, target));
+  real score = sigmoid(dotOutput(target));
   real alpha = lr * (real(label) - score);
-  grad_.addRow(*wo_, target, alpha);
-  wo_->addRow(hidden_, target, alpha);
+  updateOutput(target, alpha);
   if (label) {
     return -log(score);
   } else {
@@ -56,7 +108,7 @@ real Model::binaryLogistic(int32_t target, bool label, real lr) {
 
 real Model::negativeSampling(int32_t target, real lr) {
   real loss = 0.0;
-  grad_.zero();
+  prefetchNegatives();
   for (int32_t n = 0; n <= args_->neg; n++) {
     if (n == 0) {
       loss += binaryLogistic(target, true, lr);
@@ -67,11 +119,28 @@ real Model::negativeSampling(int32_t target, real lr) {
   return loss;
 }
 
+// The targets of a skipgram window share the hidden vector, so a negative
+// drawn once scores the same for every target: it is scored and updated once
+// with the gradient of all targets.
+real Model::sharedNegativeSampling(const std::vector<int32_t>& targets,
+                                   real lr) {
+  real loss = 0.0;
+  real weight = targets.size();
+  prefetchNegatives();
+  for (auto it = targets.cbegin(); it != targets.cend(); ++it) {
+    loss += binaryLogistic(*it, true, lr);
+  }
+  for (int32_t n = 0; n < args_->neg; n++) {
+    loss += weight * binaryLogistic(getNegative(targets), false, weight * lr);
+  }
+  return loss;
+}
+
 real Model::hierarchicalSoftmax(int32_t target, real lr) {
   real loss = 0.0;
-  grad_.zero();
   const std::vector<bool>& binaryCode = codes[target];
   const std::vector<int32_t>& pathToRoot = paths[target];
+  prefetchOutput(pathToRoot);
   for (int32_t i = 0; i < pathToRoot.size(); i++) {
     loss += binaryLogistic(pathToRoot[i], binaryCode[i], lr);
   }
@@ -98,22 +167,91 @@ void Model::computeOutputSoftmax() {
 }
 
 real Model::softmax(int32_t target, real lr) {
-  grad_.zero();
   computeOutputSoftmax();
   for (int32_t i = 0; i < osz_; i++) {
     real label = (i == target) ? 1.0 : 0.0;
     real alpha = lr * (label - output_[i]);
-    grad_.addRow(*wo_, i, alpha);
-    wo_->addRow(hidden_, i, alpha);
+    updateOutput(i, alpha);
   }
   return -log(output_[target]);
 }
 
+real Model::softmax(int32_t begin, int32_t end, int32_t target, real lr) {
+  real max = dotOutput(begin), z = 0.0;
+  for (int32_t i = begin; i < end; i++) {
+    output_[i - begin] = dotOutput(i);
+    max = std::max(output_[i - begin], max);
+  }
+  for (int32_t i = begin; i < end; i++) {
+    output_[i - begin] = exp(output_[i - begin] - max);
+    z += output_[i - begin];
+  }
+  for (int32_t i = begin; i < end; i++) {
+    real label = (i == target) ? 1.0 : 0.0;
+    real alpha = lr * (label - output_[i - begin] / z);
+    updateOutput(i, alpha);
+  }
+  return -log(output_[target - begin] / z);
+}
+
+int32_t Model::getCluster(int32_t target) const {
+  return std::upper_bound(cutoffs_.begin(), cutoffs_.end(), target)
+    - cutoffs_.begin() - 1;
+}
+
+// Rows of wo_ are laid out as [head labels | cluster rows | tail labels] so
+// that the head softmax and every tail cluster softmax span contiguous rows.
+real Model::adaptiveSoftmax(int32_t target, real lr) {
+  int32_t head = cutoffs_[0];
+  int32_t nclusters = cutoffs_.size() - 1;
+  if (target < head) {
+    return softmax(0, head + nclusters, target, lr);
+  }
+  int32_t cluster = getCluster(target);
+  real loss = softmax(0, head + nclusters, head + cluster, lr);
+  loss += softmax(cutoffs_[cluster] + nclusters,
+                  cutoffs_[cluster + 1] + nclusters,
+                  target + nclusters, lr);
+  return loss;
+}
+
+real Model::sampledSoftmax(int32_t target, real lr) {
+  samples_.resize(args_->neg + 1);
+  logits_.resize(args_->neg + 1);
+  samples_[0] = target;
+  for (int32_t n = 1; n <= args_->neg; n++) {
+    samples_[n] = getNegative(target);
+  }
+  real max = 0.0, z = 0.0;
+  for (int32_t n = 0; n <= args_->neg; n++) {
+    logits_[n] = dotOutput(samples_[n]) - logQ_[samples_[n]];
+    max = (n == 0) ? logits_[n] : std::max(logits_[n], max);
+  }
+  for (int32_t n = 0; n <= args_->neg; n++) {
+    logits_[n] = exp(logits_[n] - max);
+    z += logits_[n];
+  }
+  for (int32_t n = 0; n <= args_->neg; n++) {
+    real label = (n == 0) ? 1.0 : 0.0;
+    real alpha = lr * (label - logits_[n] / z);
+    updateOutput(samples_[n], alpha);
+  }
+  return -log(logits_[0] / z);
+}
+
 void Model::computeHidden(const std::vector<int32_t>& input, Vector& hidden) const {
   assert(hidden.size() == hsz_);
   hidden.zero();
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    hidden.addRow(*wi_, *it);
+  for (int32_t i = 0; i < args_->prefetch; i++) {
+    prefetchInput(input, i, false);
+  }
+  for (size_t i = 0; i < input.size(); i++) {
+    prefetchInput(input, i + args_->prefetch, false);
+    if (inBuf_.contains(input[i])) {
+      inBuf_.addRowTo(hidden, input[i]);
+    } else {
+      hidden.addRow(*wi_, input[i]);
+    }
   }
   hidden.mul(1.0 / input.size());
 }
@@ -125,12 +263,22 @@ bool Model::comparePairs(const std::pair<real, int32_t> &l,
 
 void Model::predict(const std::vector<int32_t>& input, int32_t k,
                     std::vector<std::pair<real, int32_t>>& heap,
-                    Vector& hidden, Vector& output) const {
+                    std::vector<std::pair<real, int32_t>>& frontier,
+                    Vector& hidden, Vector& output, bool exact) const {
   assert(k > 0);
   heap.reserve(k + 1);
   computeHidden(input, hidden);
   if (args_->loss == loss_name::hs) {
-    dfs(k, 2 * osz_ - 2, 0.0, heap, hidden);
+    if (args_->beam > 0) {
+      treeBeamKBest(k, args_->beam, heap, frontier, hidden);
+    } else {
+      treeKBest(k, heap, frontier, hidden);
+    }
+  } else if (args_->loss == loss_name::adaptive) {
+    adaptiveKBest(k, heap, hidden, output);
+  } else if (labelIndex_ && !exact) {
+    labelIndex_->search(hidden, k, nprobe_, heap, frontier);
+    std::make_heap(heap.begin(), heap.end(), comparePairs);
   } else {
     findKBest(k, heap, hidden, output);
   }
@@ -139,66 +287,290 @@ void Model::predict(const std::vector<int32_t>& input, int32_t k,
 
 void Model::predict(const std::vector<int32_t>& input, int32_t k,
                     std::vector<std::pair<real, int32_t>>& heap) {
-  predict(input, k, heap, hidden_, output_);
+  predict(input, k, heap, frontier_, hidden_, output_);
 }
 
+// Exact top-k on the logits, which order the labels like their
+// probabilities: one pass scores every label, a second keeps the k best and
+// sums the exponentials for the normalizer, and only the k winners are
+// turned into log-probabilities.
 void Model::findKBest(int32_t k, std::vector<std::pair<real, int32_t>>& heap,
                       Vector& hidden, Vector& output) const {
-  computeOutputSoftmax(hidden, output);
   for (int32_t i = 0; i < osz_; i++) {
-    if (heap.size() == k && log(output[i]) < heap.front().first) {
-      continue;
+    output[i] = dotProduct(hidden.data_, wo_->data_ + int64_t(i) * hsz_, hsz_);
+  }
+  selectKBest(k, output.data_, heap);
+}
+
+void Model::selectKBest(int32_t k, const real* logits,
+                        std::vector<std::pair<real, int32_t>>& heap) const {
+  real max = logits[0];
+  for (int32_t i = 0; i < osz_; i++) {
+    if (logits[i] > max) {
+      max = logits[i];
+    }
+    pushKBest(k, logits[i], i, heap);
+  }
+  real z = 0.0;
+  for (int32_t i = 0; i < osz_; i++) {
+    z += exp(logits[i] - max);
+  }
+  real lse = max + std::log(z);
+  for (auto it = heap.begin(); it != heap.end(); ++it) {
+    it->first -= lse;
+  }
+}
+
+// block holds count hidden vectors one after the other. Tiles of
+// SCORE_TILE output rows by SCORE_TILE vectors keep their partial sums in
+// registers, so each load of a row or a vector feeds SCORE_TILE products;
+// the rows and vectors left over go through dotProduct.
+void Model::scoreBlock(const real* block, int32_t count, real* logits) const {
+  int32_t rows = osz_ - osz_ % SCORE_TILE;
+  int32_t tiled = count - count % SCORE_TILE;
+  int32_t width = hsz_ - hsz_ % 4;
+  for (int32_t i = 0; i < rows; i += SCORE_TILE) {
+    const real* row = wo_->data_ + int64_t(i) * hsz_;
+    for (int32_t q = 0; q < tiled; q += SCORE_TILE) {
+      const real* vec = block + int64_t(q) * hsz_;
+      real sums[SCORE_TILE][SCORE_TILE][4] = {};
+      for (int32_t j = 0; j < width; j += 4) {
+        for (int32_t r = 0; r < SCORE_TILE; r++) {
+          for (int32_t c = 0; c < SCORE_TILE; c++) {
+            for (int32_t t = 0; t < 4; t++) {
+              sums[r][c][t] += row[r * hsz_ + j + t] * vec[c * hsz_ + j + t];
+            }
+          }
+        }
+      }
+      for (int32_t r = 0; r < SCORE_TILE; r++) {
+        for (int32_t c = 0; c < SCORE_TILE; c++) {
+          real score = sums[r][c][0] + sums[r][c][1] +
+                       sums[r][c][2] + sums[r][c][3];
+          for (int32_t j = width; j < hsz_; j++) {
+            score += row[r * hsz_ + j] * vec[c * hsz_ + j];
+          }
+          logits[int64_t(q + c) * osz_ + i + r] = score;
+        }
+      }
     }
-    heap.push_back(std::make_pair(log(output[i]), i));
-    std::push_heap(heap.begin(), heap.end(), comparePairs);
-    if (heap.size() > k) {
-      std::pop_heap(heap.begin(), heap.end(), comparePairs);
-      heap.pop_back();
+    for (int32_t q = tiled; q < count; q++) {
+      for (int32_t r = 0; r < SCORE_TILE; r++) {
+        logits[int64_t(q) * osz_ + i + r] =
+            dotProduct(block + int64_t(q) * hsz_, row + r * hsz_, hsz_);
+      }
+    }
+  }
+  for (int32_t i = rows; i < osz_; i++) {
+    const real* row = wo_->data_ + int64_t(i) * hsz_;
+    for (int32_t q = 0; q < count; q++) {
+      logits[int64_t(q) * osz_ + i] =
+          dotProduct(block + int64_t(q) * hsz_, row, hsz_);
     }
   }
 }
 
-void Model::dfs(int32_t k, int32_t node, real score,
-                std::vector<std::pair<real, int32_t>>& heap,
-                Vector& hidden) const {
-  if (heap.size() == k && score < heap.front().first) {
+void Model::predict(const std::vector<std::vector<int32_t>>& inputs, size_t n,
+                    int32_t k,
+                    std::vector<std::vector<std::pair<real, int32_t>>>& heaps,
+                    std::vector<std::pair<real, int32_t>>& frontier,
+                    Vector& hidden, Vector& output,
+                    std::vector<real>& scratch) const {
+  bool batched = (args_->loss == loss_name::softmax ||
+                  args_->loss == loss_name::ns) && !labelIndex_;
+  if (!batched) {
+    for (size_t q = 0; q < n; q++) {
+      heaps[q].clear();
+      predict(inputs[q], k, heaps[q], frontier, hidden, output);
+    }
     return;
   }
-
-  if (tree[node].left == -1 && tree[node].right == -1) {
-    heap.push_back(std::make_pair(score, node));
-    std::push_heap(heap.begin(), heap.end(), comparePairs);
-    if (heap.size() > k) {
-      std::pop_heap(heap.begin(), heap.end(), comparePairs);
-      heap.pop_back();
+  scratch.resize(int64_t(BATCH_BLOCK) * (hsz_ + osz_));
+  real* block = scratch.data();
+  real* logits = block + BATCH_BLOCK * hsz_;
+  for (size_t begin = 0; begin < n; begin += BATCH_BLOCK) {
+    int32_t count = std::min(n - begin, size_t(BATCH_BLOCK));
+    for (int32_t q = 0; q < count; q++) {
+      computeHidden(inputs[begin + q], hidden);
+      std::copy(hidden.data_, hidden.data_ + hsz_, block + q * hsz_);
+    }
+    scoreBlock(block, count, logits);
+    for (int32_t q = 0; q < count; q++) {
+      std::vector<std::pair<real, int32_t>>& heap = heaps[begin + q];
+      heap.clear();
+      heap.reserve(k + 1);
+      selectKBest(k, logits + int64_t(q) * osz_, heap);
+      std::sort_heap(heap.begin(), heap.end(), comparePairs);
     }
+  }
+}
+
+void Model::pushKBest(int32_t k, real score, int32_t label,
+                      std::vector<std::pair<real, int32_t>>& heap) {
+  if (heap.size() == size_t(k) && score < heap.front().first) {
     return;
   }
+  heap.push_back(std::make_pair(score, label));
+  std::push_heap(heap.begin(), heap.end(), comparePairs);
+  if (heap.size() > size_t(k)) {
+    std::pop_heap(heap.begin(), heap.end(), comparePairs);
+    heap.pop_back();
+  }
+}
 
-  real f = sigmoid(wo_->dotRow(hidden, node - osz_));
-  dfs(k, tree[node].left, score + log(1.0 - f), heap, hidden);
-  dfs(k, tree[node].right, score + log(f), heap, hidden);
+void Model::computeLogSoftmax(int32_t begin, int32_t end,
+                              Vector& hidden, Vector& output) const {
+  real max = wo_->dotRow(hidden, begin), z = 0.0;
+  for (int32_t i = begin; i < end; i++) {
+    output[i - begin] = wo_->dotRow(hidden, i);
+    max = std::max(output[i - begin], max);
+  }
+  for (int32_t i = begin; i < end; i++) {
+    z += exp(output[i - begin] - max);
+  }
+  real lse = max + std::log(z);
+  for (int32_t i = begin; i < end; i++) {
+    output[i - begin] -= lse;
+  }
 }
 
-void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+// Exact top-k: a label scores at most the log-probability of its cluster, so
+// clusters are visited by decreasing probability until none can enter the heap.
+void Model::adaptiveKBest(int32_t k,
+                          std::vector<std::pair<real, int32_t>>& heap,
+                          Vector& hidden, Vector& output) const {
+  int32_t head = cutoffs_[0];
+  int32_t nclusters = cutoffs_.size() - 1;
+  computeLogSoftmax(0, head + nclusters, hidden, output);
+  for (int32_t i = 0; i < head; i++) {
+    pushKBest(k, output[i], i, heap);
+  }
+  std::vector<std::pair<real, int32_t>> clusters;
+  for (int32_t j = 0; j < nclusters; j++) {
+    clusters.push_back(std::make_pair(output[head + j], j));
+  }
+  std::sort(clusters.begin(), clusters.end(), comparePairs);
+  for (auto it = clusters.cbegin(); it != clusters.cend(); ++it) {
+    if (heap.size() == size_t(k) && it->first < heap.front().first) {
+      break;
+    }
+    int32_t begin = cutoffs_[it->second];
+    int32_t end = cutoffs_[it->second + 1];
+    computeLogSoftmax(begin + nclusters, end + nclusters, hidden, output);
+    for (int32_t i = begin; i < end; i++) {
+      pushKBest(k, it->first + output[i - begin], i, heap);
+    }
+  }
+}
+
+// Exact top-k: a node scores the log-probability of its path, which only
+// decreases downwards, so subtrees below the k-th best leaf are skipped. The
+// more likely child is visited first to find good leaves early.
+void Model::treeKBest(int32_t k, std::vector<std::pair<real, int32_t>>& heap,
+                      std::vector<std::pair<real, int32_t>>& stack,
+                      Vector& hidden) const {
+  stack.clear();
+  stack.push_back(std::make_pair(0.0, 2 * osz_ - 2));
+  while (!stack.empty()) {
+    real score = stack.back().first;
+    int32_t node = stack.back().second;
+    stack.pop_back();
+    if (heap.size() == size_t(k) && score < heap.front().first) {
+      continue;
+    }
+    if (tree[node].left == -1 && tree[node].right == -1) {
+      pushKBest(k, score, node, heap);
+      continue;
+    }
+    real f = sigmoid(wo_->dotRow(hidden, node - osz_));
+    std::pair<real, int32_t> left(score + log(1.0 - f), tree[node].left);
+    std::pair<real, int32_t> right(score + log(f), tree[node].right);
+    if (left.first < right.first) {
+      std::swap(left, right);
+    }
+    stack.push_back(right);
+    stack.push_back(left);
+  }
+}
+
+// Best-first search keeping the beam most likely nodes of the frontier: the
+// work per prediction is bounded, and the leaves still come out in decreasing
+// order, so the first k are returned.
+void Model::treeBeamKBest(int32_t k, int32_t beam,
+                          std::vector<std::pair<real, int32_t>>& heap,
+                          std::vector<std::pair<real, int32_t>>& frontier,
+                          Vector& hidden) const {
+  // a max-heap, unlike the min-heap of the k best
+  auto better = [](const std::pair<real, int32_t>& l,
+                   const std::pair<real, int32_t>& r) {
+    return l.first < r.first;
+  };
+  frontier.clear();
+  frontier.push_back(std::make_pair(0.0, 2 * osz_ - 2));
+  while (!frontier.empty() && heap.size() < size_t(k)) {
+    std::pop_heap(frontier.begin(), frontier.end(), better);
+    real score = frontier.back().first;
+    int32_t node = frontier.back().second;
+    frontier.pop_back();
+    if (tree[node].left == -1 && tree[node].right == -1) {
+      pushKBest(k, score, node, heap);
+      continue;
+    }
+    real f = sigmoid(wo_->dotRow(hidden, node - osz_));
+    frontier.push_back(std::make_pair(score + log(1.0 - f), tree[node].left));
+    std::push_heap(frontier.begin(), frontier.end(), better);
+    frontier.push_back(std::make_pair(score + log(f), tree[node].right));
+    std::push_heap(frontier.begin(), frontier.end(), better);
+    while (frontier.size() > size_t(beam)) {
+      // the worst node is one of the leaves of the heap; the last element
+      // takes its place and moves up
+      auto worst = std::min_element(frontier.begin() + frontier.size() / 2,
+                                    frontier.end(), better);
+      *worst = frontier.back();
+      frontier.pop_back();
+      if (worst != frontier.end()) {
+        std::push_heap(frontier.begin(), worst + 1, better);
+      }
+    }
+  }
+}
+
+real Model::computeLoss(int32_t target, real lr) {
   assert(target >= 0);
   assert(target < osz_);
-  if (input.size() == 0) return;
-  computeHidden(input, hidden_);
   if (args_->loss == loss_name::ns) {
-    loss_ += negativeSampling(target, lr);
+    return negativeSampling(target, lr);
   } else if (args_->loss == loss_name::hs) {
-    loss_ += hierarchicalSoftmax(target, lr);
+    return hierarchicalSoftmax(target, lr);
+  } else if (args_->loss == loss_name::adaptive) {
+    return adaptiveSoftmax(target, lr);
+  } else if (args_->loss == loss_name::sampled) {
+    return sampledSoftmax(target, lr);
   } else {
-    loss_ += softmax(target, lr);
+    return softmax(target, lr);
   }
-  nexamples_ += 1;
+}
 
+void Model::updateInput(const std::vector<int32_t>& input) {
   if (args_->model == model_name::sup) {
     grad_.mul(1.0 / input.size());
   }
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    wi_->addRow(grad_, *it, 1.0);
+  for (int32_t i = 0; i < args_->prefetch; i++) {
+    prefetchInput(input, i, true);
+  }
+  for (size_t i = 0; i < input.size(); i++) {
+    prefetchInput(input, i + args_->prefetch, true);
+    if (inTracker_) {
+      inTracker_->mark(input[i]);
+    }
+    if (inBuf_.contains(input[i])) {
+      inBuf_.addRow(grad_, input[i], 1.0);
+    } else {
+      wi_->addRow(grad_, input[i], 1.0);
+    }
+  }
+  if (args_->hotRows > 0 && nexamples_ - flushed_ >= args_->flushRate) {
+    flush();
   }
   if (nexamples_ % 1000 == 0) {
     std::cout << "grad: " << grad_ << std::endl;
@@ -207,16 +579,106 @@ void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
   }
 }
 
+void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+  if (input.size() == 0) return;
+  computeHidden(input, hidden_);
+  grad_.zero();
+  loss_ += computeLoss(target, lr);
+  nexamples_ += 1;
+  updateInput(input);
+}
+
+// Same as above with the hidden vector already computed by the caller, e.g.
+// from running sums of the input rows.
+void Model::update(const std::vector<int32_t>& input, const Vector& hidden,
+                   int32_t target, real lr) {
+  if (input.size() == 0) return;
+  assert(hidden.size() == hsz_);
+  hidden_.zero();
+  hidden_.addVec(hidden);
+  grad_.zero();
+  loss_ += computeLoss(target, lr);
+  nexamples_ += 1;
+  updateInput(input);
+}
+
+// Several targets for the same input, e.g. the context of a skipgram center:
+// the hidden vector is computed once and the input rows are written once with
+// the gradient accumulated over all targets.
+void Model::update(const std::vector<int32_t>& input,
+                   const std::vector<int32_t>& targets, real lr) {
+  if (input.size() == 0 || targets.size() == 0) return;
+  computeHidden(input, hidden_);
+  grad_.zero();
+  if (args_->sharedNegatives && args_->loss == loss_name::ns) {
+    loss_ += sharedNegativeSampling(targets, lr);
+    nexamples_ += targets.size();
+  } else {
+    for (auto it = targets.cbegin(); it != targets.cend(); ++it) {
+      loss_ += computeLoss(*it, lr);
+      nexamples_ += 1;
+    }
+  }
+  updateInput(input);
+}
+
+const Vector& Model::getGrad() const {
+  return grad_;
+}
+
+// predictions of softmax and ns models only scan the nprobe lists of index
+void Model::setLabelIndex(std::shared_ptr<LabelIndex> index, int32_t nprobe) {
+  labelIndex_ = index;
+  nprobe_ = nprobe;
+}
+
+bool Model::hasLabelIndex() const {
+  return labelIndex_ != nullptr;
+}
+
 void Model::setTargetCounts(const std::vector<int64_t>& counts) {
+  if (args_->loss == loss_name::adaptive) {
+    cutoffs_ = getCutoffs(counts);
+    osz_ = counts.size();
+    assert(wo_->m_ == outputSize(*args_, counts));
+  }
   assert(counts.size() == osz_);
-  if (args_->loss == loss_name::ns) {
+  if (args_->loss == loss_name::ns || args_->loss == loss_name::sampled) {
     initTableNegatives(counts);
   }
+  if (args_->loss == loss_name::sampled) {
+    initLogQ(counts);
+  }
   if (args_->loss == loss_name::hs) {
     buildTree(counts);
   }
 }
 
+// Frequent words have the lowest ids in both matrices, except with
+// hierarchical softmax where the nodes closest to the root come last.
+void Model::initHotRows() {
+  int64_t n = args_->hotRows;
+  inBuf_.reset(wi_, 0, std::min<int64_t>(n, isz_));
+  if (args_->loss == loss_name::hs) {
+    int64_t end = std::max(osz_ - 1, 0);
+    outBuf_.reset(wo_, std::max<int64_t>(end - n, 0), end);
+  } else {
+    outBuf_.reset(wo_, 0, std::min<int64_t>(n, wo_->m_));
+  }
+}
+
+void Model::setTrackers(std::shared_ptr<RowTracker> in,
+                        std::shared_ptr<RowTracker> out) {
+  inTracker_ = in;
+  outTracker_ = out;
+}
+
+void Model::flush() {
+  flushed_ = nexamples_;
+  inBuf_.flush();
+  outBuf_.flush();
+}
+
 void Model::initTableNegatives(const std::vector<int64_t>& counts) {
   real z = 0.0;
   for (size_t i = 0; i < counts.size(); i++) {
@@ -231,6 +693,49 @@ void Model::initTableNegatives(const std::vector<int64_t>& counts) {
   std::shuffle(negatives.begin(), negatives.end(), rng);
 }
 
+// Sampled softmax subtracts the log expected number of draws of each label
+// from the negatives table, which keeps the estimate close to a full softmax.
+void Model::initLogQ(const std::vector<int64_t>& counts) {
+  real z = 0.0;
+  for (size_t i = 0; i < counts.size(); i++) {
+    z += pow(counts[i], 0.5);
+  }
+  logQ_.resize(counts.size());
+  for (size_t i = 0; i < counts.size(); i++) {
+    logQ_[i] = std::log(args_->neg * pow(counts[i], 0.5) / z);
+  }
+}
+
+std::vector<int32_t> Model::getCutoffs(const std::vector<int64_t>& counts) {
+  int32_t osz = counts.size();
+  int64_t total = 0;
+  for (int32_t i = 0; i < osz; i++) {
+    total += counts[i];
+  }
+  int32_t head = 0;
+  int64_t covered = 0;
+  while (head < osz && covered * 100 < total * ADAPTIVE_HEAD_PERCENT) {
+    covered += counts[head++];
+  }
+  head = std::max(head, std::min(osz, 1));
+  std::vector<int32_t> cutoffs(1, head);
+  int64_t size = head;
+  while (cutoffs.back() < osz) {
+    size *= ADAPTIVE_GROWTH;
+    cutoffs.push_back(std::min<int64_t>(osz, cutoffs.back() + size));
+  }
+  return cutoffs;
+}
+
+int64_t Model::outputSize(const Args& args,
+                          const std::vector<int64_t>& counts) {
+  int64_t osz = counts.size();
+  if (args.loss == loss_name::adaptive) {
+    osz += getCutoffs(counts).size() - 1;
+  }
+  return osz;
+}
+
 int32_t Model::getNegative(int32_t target) {
   int32_t negative;
   do {
@@ -240,6 +745,20 @@ int32_t Model::getNegative(int32_t target) {
   return negative;
 }
 
+// skips the targets, unless they fill so much of the table (e.g. a tiny
+// vocabulary) that MAX_NEGATIVE_TRIES draws hit them all, then one is taken
+int32_t Model::getNegative(const std::vector<int32_t>& targets) {
+  int32_t negative;
+  int32_t tries = 0;
+  do {
+    negative = negatives[negpos];
+    negpos = (negpos + 1) % negatives.size();
+  } while (++tries < MAX_NEGATIVE_TRIES &&
+           std::find(targets.begin(), targets.end(), negative) !=
+               targets.end());
+  return negative;
+}
+
 void Model::buildTree(const std::vector<int64_t>& counts) {
   tree.resize(2 * osz_ - 1);
   for (int32_t i = 0; i < 2 * osz_ - 1; i++) {
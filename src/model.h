@@ -16,7 +16,10 @@
 #include <memory>
 
 #include "args.h"
+#include "cluster.h"
+#include "ivf.h"
 #include "matrix.h"
+#include "rowbuffer.h"
 #include "vector.h"
 #include "real.h"
 
@@ -48,6 +51,13 @@ class Model {
     int32_t osz_;
     real loss_;
     int64_t nexamples_;
+    int64_t flushed_;
+    // thread-private copies of the most frequently updated rows
+    RowBuffer inBuf_;
+    RowBuffer outBuf_;
+    // rows written since the last merge with other processes
+    std::shared_ptr<RowTracker> inTracker_;
+    std::shared_ptr<RowTracker> outTracker_;
     real* t_sigmoid;
     real* t_log;
     // used for negative sampling:
@@ -57,15 +67,58 @@ class Model {
     std::vector< std::vector<int32_t> > paths;
     std::vector< std::vector<bool> > codes;
     std::vector<Node> tree;
+    // used for adaptive softmax: cluster boundaries over the sorted labels,
+    // cutoffs_[0] is the head size and the last entry is osz_
+    std::vector<int32_t> cutoffs_;
+    // used for sampled softmax:
+    std::vector<real> logQ_;
+    std::vector<int32_t> samples_;
+    std::vector<real> logits_;
+    // tree nodes still to visit in hierarchical softmax prediction
+    std::vector<std::pair<real, int32_t>> frontier_;
+    // approximate top-k over the labels, when loaded
+    std::shared_ptr<LabelIndex> labelIndex_;
+    int32_t nprobe_;
 
     static bool comparePairs(const std::pair<real, int32_t>&,
                              const std::pair<real, int32_t>&);
+    static void pushKBest(int32_t, real, int32_t,
+                          std::vector<std::pair<real, int32_t>>&);
 
     int32_t getNegative(int32_t target);
+    int32_t getNegative(const std::vector<int32_t>& targets);
+    real computeLoss(int32_t, real);
+    void updateInput(const std::vector<int32_t>&);
+    real dotOutput(int32_t);
+    void updateOutput(int32_t, real);
+    void prefetchInput(const std::vector<int32_t>&, size_t, bool) const;
+    void prefetchOutput(const std::vector<int32_t>&) const;
+    void prefetchNegatives() const;
+    int32_t getCluster(int32_t target) const;
+    real softmax(int32_t, int32_t, int32_t, real);
+    void computeLogSoftmax(int32_t, int32_t, Vector&, Vector&) const;
+    void adaptiveKBest(int32_t, std::vector<std::pair<real, int32_t>>&,
+                       Vector&, Vector&) const;
+    void treeKBest(int32_t, std::vector<std::pair<real, int32_t>>&,
+                   std::vector<std::pair<real, int32_t>>&, Vector&) const;
+    void treeBeamKBest(int32_t, int32_t,
+                       std::vector<std::pair<real, int32_t>>&,
+                       std::vector<std::pair<real, int32_t>>&, Vector&) const;
+    void selectKBest(int32_t, const real*,
+                     std::vector<std::pair<real, int32_t>>&) const;
+    void scoreBlock(const real*, int32_t, real*) const;
     void initSigmoid();
     void initLog();
 
     static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
+    // draws a shared negative may reject before a target is taken
+    static const int32_t MAX_NEGATIVE_TRIES = 64;
+    static const int32_t ADAPTIVE_HEAD_PERCENT = 80;
+    static const int32_t ADAPTIVE_GROWTH = 4;
+    // hidden vectors scored together by a batched prediction, and the
+    // output rows and vectors that share each load in scoreBlock
+    static const int32_t BATCH_BLOCK = 16;
+    static const int32_t SCORE_TILE = 4;
 
   public:
     Model(std::shared_ptr<Matrix>, std::shared_ptr<Matrix>,
@@ -74,28 +127,50 @@ class Model {
 
     real binaryLogistic(int32_t, bool, real);
     real negativeSampling(int32_t, real);
+    real sharedNegativeSampling(const std::vector<int32_t>&, real);
     real hierarchicalSoftmax(int32_t, real);
     real softmax(int32_t, real);
+    real adaptiveSoftmax(int32_t, real);
+    real sampledSoftmax(int32_t, real);
 
+    // the second vector is scratch for the tree search of hs models and the
+    // label index; exact scores every label even with a label index
     void predict(const std::vector<int32_t>&, int32_t,
                  std::vector<std::pair<real, int32_t>>&,
-                 Vector&, Vector&) const;
+                 std::vector<std::pair<real, int32_t>>&,
+                 Vector&, Vector&, bool exact = false) const;
     void predict(const std::vector<int32_t>&, int32_t,
                  std::vector<std::pair<real, int32_t>>&);
-    void dfs(int32_t, int32_t, real,
-             std::vector<std::pair<real, int32_t>>&,
-             Vector&) const;
+    // the first n inputs, each into its own heap; softmax and ns models
+    // without a label index score BATCH_BLOCK inputs per pass over the
+    // output rows, the last vector is scratch
+    void predict(const std::vector<std::vector<int32_t>>&, size_t, int32_t,
+                 std::vector<std::vector<std::pair<real, int32_t>>>&,
+                 std::vector<std::pair<real, int32_t>>&,
+                 Vector&, Vector&, std::vector<real>&) const;
     void findKBest(int32_t, std::vector<std::pair<real, int32_t>>&,
                    Vector&, Vector&) const;
     void update(const std::vector<int32_t>&, int32_t, real);
+    void update(const std::vector<int32_t>&, const Vector&, int32_t, real);
+    void update(const std::vector<int32_t>&, const std::vector<int32_t>&,
+                real);
     void computeHidden(const std::vector<int32_t>&, Vector&) const;
     void computeOutputSoftmax(Vector&, Vector&) const;
     void computeOutputSoftmax();
 
     void setTargetCounts(const std::vector<int64_t>&);
+    void setLabelIndex(std::shared_ptr<LabelIndex>, int32_t);
+    bool hasLabelIndex() const;
+    void initHotRows();
+    void setTrackers(std::shared_ptr<RowTracker>, std::shared_ptr<RowTracker>);
+    void flush();
     void initTableNegatives(const std::vector<int64_t>&);
     void buildTree(const std::vector<int64_t>&);
+    void initLogQ(const std::vector<int64_t>&);
+    static std::vector<int32_t> getCutoffs(const std::vector<int64_t>&);
+    static int64_t outputSize(const Args&, const std::vector<int64_t>&);
     real getLoss() const;
+    const Vector& getGrad() const;
     real sigmoid(real) const;
     real log(real) const;
 
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "numa.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "utils.h"
+
+namespace fasttext {
+
+namespace numa {
+
+  static std::string cpulist(int32_t node) {
+    std::ifstream ifs("/sys/devices/system/node/node" +
+                      std::to_string(node) + "/cpulist");
+    std::string line;
+    if (ifs.is_open()) {
+      std::getline(ifs, line);
+    }
+    return line;
+  }
+
+  int32_t nodes() {
+    int32_t n = 0;
+    while (!cpulist(n).empty()) {
+      n++;
+    }
+    return n > 0 ? n : 1;
+  }
+
+  std::vector<int32_t> cpus(int32_t node) {
+    std::vector<int32_t> result;
+    std::vector<std::string> ranges = utils::split(cpulist(node), ',');
+    for (auto it = ranges.cbegin(); it != ranges.cend(); ++it) {
+      std::vector<std::string> bounds = utils::split(*it, '-');
+      int32_t first = atoi(bounds[0].c_str());
+      int32_t last = bounds.size() > 1 ? atoi(bounds[1].c_str()) : first;
+      for (int32_t cpu = first; cpu <= last; cpu++) {
+        result.push_back(cpu);
+      }
+    }
+    return result;
+  }
+
+  bool bind(int32_t node) {
+#ifdef __linux__
+    std::vector<int32_t> list = cpus(node);
+    if (list.empty()) {
+      return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto it = list.cbegin(); it != list.cend(); ++it) {
+      CPU_SET(*it, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+  }
+
+}
+
+Replicas::Replicas(std::shared_ptr<Matrix> matrix, int32_t nodes) {
+  replicas_.resize(nodes);
+  replicas_[0] = matrix;
+  std::vector<std::thread> threads;
+  for (int32_t node = 1; node < nodes; node++) {
+    threads.push_back(std::thread([=]() {
+      numa::bind(node);
+      std::shared_ptr<Matrix> replica =
+        std::make_shared<Matrix>(matrix->m_, matrix->n_);
+      matrix->copyTo(*replica);
+      replicas_[node] = replica;
+    }));
+  }
+  for (auto it = threads.begin(); it != threads.end(); ++it) {
+    it->join();
+  }
+}
+
+int32_t Replicas::size() const {
+  return replicas_.size();
+}
+
+std::shared_ptr<Matrix> Replicas::get(int32_t node) const {
+  return replicas_[node];
+}
+
+// Racy by design: trainers keep writing while rows are averaged, as Hogwild.
+void Replicas::average(int64_t begin, int64_t end) {
+  int64_t n = replicas_[0]->n_;
+  real scale = 1.0 / replicas_.size();
+  for (int64_t i = begin * n; i < end * n; i++) {
+    real sum = 0.0;
+    for (size_t r = 0; r < replicas_.size(); r++) {
+      sum += replicas_[r]->data_[i];
+    }
+    sum *= scale;
+    for (size_t r = 0; r < replicas_.size(); r++) {
+      replicas_[r]->data_[i] = sum;
+    }
+  }
+}
+
+}
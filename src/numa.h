@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_NUMA_H
+#define FASTTEXT_NUMA_H
+
+#include <memory>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+namespace numa {
+
+  int32_t nodes();
+  std::vector<int32_t> cpus(int32_t node);
+  bool bind(int32_t node);
+
+}
+
+/**
+ * One copy of a matrix per NUMA node. Every copy is allocated and first
+ * touched by a thread bound to its node, so its pages stay local to the
+ * trainers of that node. Replica 0 is the original matrix.
+ */
+class Replicas {
+  public:
+    Replicas(std::shared_ptr<Matrix>, int32_t nodes);
+
+    int32_t size() const;
+    std::shared_ptr<Matrix> get(int32_t) const;
+    void average(int64_t begin, int64_t end);
+
+  private:
+    std::vector<std::shared_ptr<Matrix>> replicas_;
+};
+
+}
+
+#endif
@@ -12,6 +12,7 @@
  */
 
 #include <iostream>
+#include <thread>
 
 #include "pairtext.h"
 #include "args.h"
@@ -48,6 +49,28 @@ void printPredictUsage() {
       << std::endl;
 }
 
+void printWordEmbeddingUsage() {
+  std::cout
+      << "usage: pairtext word-embedding <model> [<index>] [<ef>]\n\n"
+      << "  <model>      model filename\n"
+      << "  <index>      (optional) index prefix from build-index\n"
+      << "  <ef>         (optional; 64 by default) candidates explored per query\n\n"
+      << "Reads \"<1|2> <word> <n>\" queries from stdin and prints the n nearest\n"
+      << "words of the first or second side.\n"
+      << std::endl;
+}
+
+void printBuildIndexUsage() {
+  std::cout
+      << "usage: pairtext build-index <model> <index> [<M>] [<ef>] [<threads>]\n\n"
+      << "  <model>      model filename\n"
+      << "  <index>      prefix of the .first and .second index files\n"
+      << "  <M>          (optional; 16 by default) links per node\n"
+      << "  <ef>         (optional; 200 by default) candidates explored per insert\n"
+      << "  <threads>    (optional; all cores by default) number of threads\n"
+      << std::endl;
+}
+
 void printPrintVectorsUsage() {
   std::cout
       << "usage: fasttext print-vectors <model>\n\n"
@@ -124,9 +147,31 @@ void printVectors(int argc, char** argv) {
 }
 
 void getSimilarityWords(int argc, char ** argv) {
+  if (argc < 3 || argc > 5) {
+    printWordEmbeddingUsage();
+    exit(EXIT_FAILURE);
+  }
+  PairText pairText;
+  pairText.loadModel(std::string(argv[2]));
+  if (argc >= 4) {
+    pairText.loadIndex(std::string(argv[3]));
+  }
+  pairText.findSimilarityWords(argc == 5 ? atoi(argv[4]) : 64);
+}
+
+void buildIndex(int argc, char** argv) {
+  if (argc < 4 || argc > 7) {
+    printBuildIndexUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t M = argc >= 5 ? atoi(argv[4]) : 16;
+  int32_t efConstruction = argc >= 6 ? atoi(argv[5]) : 200;
+  int32_t threads = argc == 7 ? atoi(argv[6])
+                              : std::thread::hardware_concurrency();
   PairText pairText;
   pairText.loadModel(std::string(argv[2]));
-  pairText.findSimilarityWords();
+  pairText.buildIndex(std::string(argv[3]), M, efConstruction, threads);
+  exit(0);
 }
 /*
 void printEmbedding(int argc, char** argv) {
@@ -161,6 +206,8 @@ int main(int argc, char** argv) {
     printVectors(argc, argv);
   } else if (command == "word-embedding") {
     getSimilarityWords(argc, argv);
+  } else if (command == "build-index") {
+    buildIndex(argc, argv);
   } else if (command == "predict" || command == "predict-prob" ) {
     predict(argc, argv);
   } else {
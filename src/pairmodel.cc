@@ -80,12 +80,28 @@ namespace fasttext {
   }
   */
 
+  // 提前把第i个词的向量取到缓存
+  static void prefetchWord(const Matrix& embedding,
+                           const std::vector<std::pair<int32_t, real>>& words,
+                           size_t i, bool write) {
+    if (i < words.size()) {
+      embedding.prefetchRow(words[i].first, write);
+    }
+  }
+
   void PairModel::computeHidden(const std::shared_ptr<Matrix> embedding,
                                 const std::vector<std::pair<int32_t, real>> &words,
                                 Vector &hidden_input, Vector &hidden_output) const {
+    const int32_t ahead = args_->prefetch;
     hidden_input.zero();
-    for (auto it = words.cbegin(); it != words.cend(); ++it) {
-      hidden_input.addRow(*embedding, it->first, 1.0);
+    for (int32_t i = 0; i < ahead; i++) {
+      prefetchWord(*embedding, words, i, false);
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+      if (ahead > 0) {
+        prefetchWord(*embedding, words, i + ahead, false);
+      }
+      hidden_input.addRow(*embedding, words[i].first, 1.0);
     }
     hidden_input.mul(1.0 / words.size());
     for (auto i = 0; i < hidden_output.m_; i++) {
@@ -101,35 +117,58 @@ namespace fasttext {
       hidden1_grad.data_[i] *= sigmoid(hidden_input.data_[i]) * (1 - sigmoid(hidden_input.data_[i]));
     }
     hidden1_grad.mul(1.0 / input.size());
-    for (auto it = input.cbegin(); it != input.cend(); ++it) {
-      embedding->addRow(hidden1_grad, it->first, 1.0);
+    RowTracker* tracker = embedding == first_embedding_ ?
+        first_tracker_.get() : second_tracker_.get();
+    const int32_t ahead = args_->prefetch;
+    for (int32_t i = 0; i < ahead; i++) {
+      prefetchWord(*embedding, input, i, true);
+    }
+    for (size_t i = 0; i < input.size(); i++) {
+      if (ahead > 0) {
+        prefetchWord(*embedding, input, i + ahead, true);
+      }
+      if (tracker) {
+        tracker->mark(input[i].first);
+      }
+      embedding->addRow(hidden1_grad, input[i].first, 1.0);
     }
   }
 
+  void PairModel::setTrackers(std::shared_ptr<RowTracker> first,
+                              std::shared_ptr<RowTracker> second) {
+    first_tracker_ = first;
+    second_tracker_ = second;
+  }
+
   real PairModel::predict(const std::vector<std::pair<int32_t, real>>& first,
                           const std::vector<std::pair<int32_t, real>>& second) const {
-    if (first.size() < 30 || second.size() < 30) return 0.0;
-    Vector first_hidden1_input(args_->dim), first_hidden1_output(args_->dim);
-    Vector second_hidden1_input(args_->dim), second_hidden1_output(args_->dim);
-    computeHidden(first_embedding_, first, first_hidden1_input, first_hidden1_output);
-    computeHidden(second_embedding_, second, second_hidden1_input, second_hidden1_output);
-
-    Vector first_output(args_->dim), second_output(args_->dim);
-
-    first_output.mul(*first_w1_, first_hidden1_output);
-    second_output.mul(*second_w1_, second_hidden1_output);
+    InferenceSession session(args_->dim, 0, 0);
+    return predict(first, second, session);
+  }
 
-/*
-    std::cout << "first hidden input " << first_hidden1_input << std::endl;
-    std::cout << "first hidden output " << first_hidden1_output << std::endl;
-    std::cout << "first output " << first_output << std::endl;
-    std::cout << "second hidden input " << second_hidden1_input << std::endl;
-    std::cout << "second hidden output " << second_hidden1_output << std::endl;
-    std::cout << "second output " << second_output << std::endl;
-*/
+  real PairModel::predict(const std::vector<std::pair<int32_t, real>>& first,
+                          const std::vector<std::pair<int32_t, real>>& second,
+                          InferenceSession& session) const {
+    if (first.size() < 30 || second.size() < 30) return 0.0;
+    tower(true, first, session);
+    tower(false, second, session);
+    return score(session.firstOutput, session.secondOutput);
+  }
 
+  void PairModel::tower(bool first,
+                        const std::vector<std::pair<int32_t, real>>& words,
+                        InferenceSession& session) const {
+    if (first) {
+      computeHidden(first_embedding_, words, session.firstInput, session.firstHidden);
+      session.firstOutput.mul(*first_w1_, session.firstHidden);
+    } else {
+      computeHidden(second_embedding_, words, session.secondInput, session.secondHidden);
+      session.secondOutput.mul(*second_w1_, session.secondHidden);
+    }
+  }
 
-    return sigmoid(dot(first_output, second_output));
+  real PairModel::score(const Vector& first, const Vector& second) const {
+    return sigmoid(dot(first, second));
   }
 
 /*
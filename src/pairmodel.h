@@ -12,9 +12,11 @@
 #include <memory>
 
 #include "args.h"
+#include "cluster.h"
 #include "matrix.h"
 #include "vector.h"
 #include "real.h"
+#include "session.h"
 
 #define SIGMOID_TABLE_SIZE 512
 #define MAX_SIGMOID 8
@@ -43,6 +45,9 @@ namespace fasttext {
     std::shared_ptr<Matrix> first_w1_;
     std::shared_ptr<Matrix> second_embedding_;
     std::shared_ptr<Matrix> second_w1_;
+    // 与其他进程合并前写过的行
+    std::shared_ptr<RowTracker> first_tracker_;
+    std::shared_ptr<RowTracker> second_tracker_;
 
     std::vector<std::pair<int32_t, real>> first_dropout_input_;
     //Vector first_hidden1_;
@@ -104,8 +109,19 @@ namespace fasttext {
               std::shared_ptr<Args> args,
               int32_t seed);
 
+    void setTrackers(std::shared_ptr<RowTracker>, std::shared_ptr<RowTracker>);
+
     real predict(const std::vector<std::pair<int32_t, real>>& first,
                  const std::vector<std::pair<int32_t, real>>& second) const;
+    // 用session里的向量计算, 不分配内存
+    real predict(const std::vector<std::pair<int32_t, real>>& first,
+                 const std::vector<std::pair<int32_t, real>>& second,
+                 InferenceSession& session) const;
+    // 一侧的输出, 写到session.firstOutput或session.secondOutput
+    void tower(bool first, const std::vector<std::pair<int32_t, real>>& words,
+               InferenceSession& session) const;
+    // 两侧输出的匹配概率
+    real score(const Vector& first, const Vector& second) const;
 
     void update(const std::vector<std::pair<int32_t, real>>& input,
                 std::shared_ptr<Matrix> embedding,
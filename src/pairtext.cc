@@ -96,6 +96,8 @@ namespace fasttext {
   }
 
   void PairText::loadModel(std::istream& in) {
+    // 旧模型算出的向量作废
+    clearCache();
     args_ = std::make_shared<Args>();
     first_dict_ = std::make_shared<Dictionary>(args_);
     first_embedding_ = std::make_shared<Matrix>();
@@ -116,9 +118,42 @@ namespace fasttext {
 
   }
 
+  void PairText::saveCheckpoint(int32_t epoch, bool best, bool blocking) {
+    TrainState state;
+    state.epoch = epoch;
+    state.tokenCount = tokenCount_->total();
+    state.bestLoss = bestLoss_;
+    state.positions = positions_.snapshot();
+    std::shared_ptr<Args> args = args_;
+    std::shared_ptr<Dictionary> first_dict = first_dict_;
+    std::shared_ptr<Dictionary> second_dict = second_dict_;
+    Checkpointer::Writer writeModel =
+        [args, first_dict, second_dict](std::ostream& out,
+                                        const Checkpointer::Matrices& m) {
+          args->save(out);
+          first_dict->save(out);
+          m[0]->save(out);
+          m[1]->save(out);
+          second_dict->save(out);
+          m[2]->save(out);
+          m[3]->save(out);
+        };
+    Checkpointer::Jobs jobs;
+    jobs.push_back(std::make_pair(args_->output + ".ckpt",
+        [writeModel, state](std::ostream& out,
+                            const Checkpointer::Matrices& m) {
+          writeModel(out, m);
+          state.save(out);
+        }));
+    if (best) {
+      jobs.push_back(std::make_pair(args_->output + ".bin", writeModel));
+    }
+    checkpointer_->save(jobs, blocking);
+  }
+
   void PairText::printInfo(real progress, real loss, real objLoss, real l2Loss) {
     real t = real(clock() - start) / CLOCKS_PER_SEC;
-    real wst = real(tokenCount) / t;
+    real wst = real(tokenCount_->total()) / t;
     real lr = args_->lr * (1.0 - progress);
     int eta = int(t / progress * (1 - progress) / args_->thread);
     int etah = eta / 3600;
@@ -187,27 +222,66 @@ namespace fasttext {
   }
 
   real PairText::predictProbability(std::istream& in) const {
-    int32_t label;
-    std::vector<std::pair<int32_t, real>> first_words;
-    std::vector<std::pair<int32_t, real>> second_words;
-
+    InferenceSession session(args_->dim, 0, 0);
     std::string first_line, second_line;
     getline(in, first_line);
     getline(in, second_line);
-    first_dict_->getWords(first_line, first_words, args_->wordNgrams, model_->rng);
-    second_dict_->getWords(second_line, second_words, args_->wordNgrams, model_->rng);
-    if (first_words.size() > 30 || second_words.size() > 30) return 0.0;
-    return model_->predict(first_words, second_words);
+    first_dict_->getWords(first_line, session.first, session.rng, session.token);
+    second_dict_->getWords(second_line, session.second, session.rng, session.token);
+    if (session.first.size() > 30 || session.second.size() > 30) return 0.0;
+    return model_->predict(session.first, session.second, session);
   }
 
   real PairText::predictProbability(const std::string& first, const std::string& second) const {
+    InferenceSession session(args_->dim, 0, 0);
+    return predictProbability(session, first, second);
+  }
+
+  std::shared_ptr<InferenceSession> PairText::createSession(int32_t seed) const {
+    return std::make_shared<InferenceSession>(args_->dim, 0, seed);
+  }
+
+  int32_t PairText::tower(bool first, const std::string& text,
+                          InferenceSession& session) const {
+    const std::shared_ptr<EmbeddingCache>& cache = first ? firstCache_ : secondCache_;
+    Vector& output = first ? session.firstOutput : session.secondOutput;
+    int32_t count;
+    if (cache && cache->get(text, output, count)) return count;
+    std::vector<std::pair<int32_t, real>>& words = first ? session.first : session.second;
+    (first ? first_dict_ : second_dict_)->getWords(text, words, session.rng, session.token);
+    count = words.size();
+    if (count >= 30) {
+      model_->tower(first, words, session);
+    }
+    if (cache) cache->put(text, output, count);
+    return count;
+  }
+
+  real PairText::predictProbability(InferenceSession& session,
+                                    const std::string& first,
+                                    const std::string& second) const {
     if (first.length() == 0 || second.length() == 0) return 0.0;
-    std::vector<std::pair<int32_t, real>> first_words;
-    std::vector<std::pair<int32_t, real>> second_words;
-    first_dict_->getWords(first, first_words, args_->wordNgrams, model_->rng);
-    second_dict_->getWords(second, second_words, args_->wordNgrams, model_->rng);
-    if (first_words.empty() || second_words.empty()) return 0.0;
-    return model_->predict(first_words, second_words);
+    if (tower(true, first, session) < 30) return 0.0;
+    if (tower(false, second, session) < 30) return 0.0;
+    return model_->score(session.firstOutput, session.secondOutput);
+  }
+
+  void PairText::setCacheSize(size_t entries) {
+    firstCache_ = entries > 0 ? std::make_shared<EmbeddingCache>(entries) : nullptr;
+    secondCache_ = entries > 0 ? std::make_shared<EmbeddingCache>(entries) : nullptr;
+  }
+
+  void PairText::clearCache() {
+    if (firstCache_) firstCache_->clear();
+    if (secondCache_) secondCache_->clear();
+  }
+
+  std::shared_ptr<EmbeddingCache> PairText::firstCache() const {
+    return firstCache_;
+  }
+
+  std::shared_ptr<EmbeddingCache> PairText::secondCache() const {
+    return secondCache_;
   }
 
   void PairText::predict(std::istream& in) {
@@ -302,55 +376,160 @@ namespace fasttext {
     }
     return false;
   }
-  void PairText::trainThread(int32_t threadId) {
-    std::ifstream ifs(args_->input);
-    utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
-    int64_t endPos = std::min(utils::size(ifs), (threadId + 1) * utils::size(ifs) / args_->thread);
-
-    // 去掉第一个不完整的样本
+  // skips the end of the record the stream was positioned in
+  static void skipIncompleteSample(std::ifstream& ifs) {
     std::string line;
     while (getline(ifs, line)) {
       if (line == "REFUSE" || line == "INTERVIEW" || line == "ACCEPT_INTERVIEW") break;
     }
-    PairModel model(first_embedding_, first_w1_, second_embedding_, second_w1_, args_, threadId);
+  }
 
-    int64_t localTokenCount = 0;
+  bool PairText::readExample(std::ifstream& ifs, Example& example,
+                             std::minstd_rand& rng) const {
     std::string first, second, third;
-    std::vector<std::pair<int32_t, real>> first_words, second_words;
-    bool label;
-    real weight = 1.0;
-    while (ifs.tellg() > 0 && ifs.tellg() < endPos) {
-      real progress = real(tokenCount) / (args_->epoch * numToken);
-      real lr = args_->lr * (1.0 - progress);
+    getline(ifs, first);
+    getline(ifs, second);
+    getline(ifs, third);
+    if (first.empty() || second.empty() || third.empty()) return false;
 
-      getline(ifs, first);
-      getline(ifs, second);
-      getline(ifs, third);
-      if (first.empty() || second.empty() || third.empty()) continue;
+    int64_t tokenCount1 = first_dict_->getWords(first, example.first, args_->wordNgrams, rng);
+
+    int64_t tokenCount2 = second_dict_->getWords(second, example.second, args_->wordNgrams, rng);
+
+    if (!convertLabel(third, example.label, example.weight) || tokenCount1 < 30 || tokenCount2 < 30) return false;
+    example.ntokens = tokenCount1 + tokenCount2;
+    return true;
+  }
 
-      int64_t tokenCount1 = first_dict_->getWords(first, first_words, args_->wordNgrams, model.rng);
+  void PairText::trainThread(int32_t threadId) {
+    std::ifstream ifs;
+    int64_t endPos = 0;
+    if (!queue_) {
+      ifs.open(args_->input);
+      // 每个进程只读自己的那一份
+      int64_t slice = args_->rank * args_->thread + threadId;
+      int64_t slices = args_->workers * args_->thread;
+      endPos = std::min(utils::size(ifs), (slice + 1) * utils::size(ifs) / slices);
+      if (positions_.get(threadId) >= 0) {
+        utils::seek(ifs, positions_.get(threadId));
+      } else {
+        utils::seek(ifs, slice * utils::size(ifs) / slices);
+
+        // 去掉第一个不完整的样本
+        skipIncompleteSample(ifs);
+      }
+    }
+    PairModel model(first_embedding_, first_w1_, second_embedding_, second_w1_, args_, threadId);
+    if (cluster_) {
+      model.setTrackers(cluster_->tracker(0), cluster_->tracker(2));
+    }
 
-      int64_t tokenCount2 = second_dict_->getWords(second, second_words, args_->wordNgrams, model.rng);
-      
-      if (!convertLabel(third, label, weight) || tokenCount1 < 30 || tokenCount2 < 30) continue;
+    int64_t localTokenCount = 0;
+    Example local;
+    local.weight = 1.0;
+    ExampleQueue::Batch* batch = nullptr;
+    size_t next = 0;
+    const int64_t ntokens = args_->epoch * numToken / args_->workers;
+    // other threads are assumed to progress at the same pace between reads
+    int64_t tokenCount = tokenCount_->total();
+    while (true) {
+      real progress = real(tokenCount + localTokenCount * args_->thread) / ntokens;
+      real lr = args_->lr * (1.0 - progress);
+
+      const Example* example = &local;
+      if (queue_) {
+        if (batch && next == batch->size) {
+          queue_->release(batch);
+          batch = nullptr;
+        }
+        if (!batch) {
+          batch = queue_->pop();
+          next = 0;
+          if (!batch) break;
+          continue;
+        }
+        example = &batch->examples[next++];
+      } else {
+        if (!(ifs.tellg() > 0 && ifs.tellg() < endPos)) break;
+        if (!readExample(ifs, local, model.rng)) continue;
+      }
 
-      localTokenCount += tokenCount1 + tokenCount2;
+      localTokenCount += example->ntokens;
 
       //first_dict_->addNgrams(first_words, args_->wordNgrams);
       //second_dict_->addNgrams(second_words, args_->wordNgrams);
-      supervised(model, lr, first_words, second_words, label, weight);
+      supervised(model, lr, example->first, example->second, example->label, example->weight);
 
       if (localTokenCount > args_->lrUpdateRate) {
-        tokenCount += localTokenCount;
+        tokenCount_->add(threadId, localTokenCount);
+        tokenCount = tokenCount_->total();
         localTokenCount = 0;
+        if (checkpointer_) {
+          if (!queue_) {
+            positions_.track(threadId, ifs);
+          }
+          if (threadId == 0 && checkpointer_->due()) {
+            saveCheckpoint(epoch_, false, false);
+          }
+        }
         if (threadId == 0 && args_->verbose > 1) {
           printInfo(progress, model.getLoss(), model.getObjLoss(), model.getL2Loss());
         }
       }
     }
+    if (batch) {
+      queue_->release(batch);
+    }
+    if (checkpointer_ && !queue_) {
+      positions_.set(threadId, endPos);
+    }
+    ifs.close();
+  }
+
+  // Readers split the input among themselves like trainers do without them,
+  // and hand parsed records over in batches.
+  void PairText::readThread(int32_t readerId) {
+    std::ifstream ifs(args_->input);
+    int64_t size = utils::size(ifs);
+    int64_t slice = args_->rank * args_->ioThread + readerId;
+    int64_t slices = args_->workers * args_->ioThread;
+    int64_t endPos = std::min(size, (slice + 1) * size / slices);
+    utils::seek(ifs, slice * size / slices);
+    skipIncompleteSample(ifs);
+
+    std::minstd_rand rng(args_->thread + readerId);
+    ExampleQueue::Batch* batch = nullptr;
+    while (ifs.tellg() > 0 && ifs.tellg() < endPos) {
+      if (!batch) {
+        batch = queue_->acquire();
+        if (!batch) break;
+        batch->size = 0;
+      }
+      if (batch->size == batch->examples.size()) {
+        batch->examples.push_back(Example());
+        batch->examples.back().weight = 1.0;
+      }
+      if (!readExample(ifs, batch->examples[batch->size], rng)) continue;
+      if (++batch->size == READ_BATCH_SIZE) {
+        queue_->push(batch);
+        batch = nullptr;
+      }
+    }
+    if (batch) {
+      queue_->push(batch);
+    }
     ifs.close();
   }
 
+  void PairText::syncThread(const std::atomic<bool>& done) {
+    bool active = true;
+    while (active) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(std::max(args_->syncInterval, 1)));
+      active = cluster_->sync(done);
+    }
+  }
+
   void PairText::loadVectors(std::string filename,
                              std::shared_ptr<Dictionary> dict,
                              std::shared_ptr<Matrix> embedding) {
@@ -382,7 +561,8 @@ namespace fasttext {
 
     dict->threshold(1, 0);
     embedding = std::make_shared<Matrix>(dict->nwords()+args_->bucket, args_->dim);
-    embedding->uniform(1.0 / args_->dim);
+    embedding->lazyUniform(1.0 / args_->dim,
+                           args_->lazyBuckets ? dict->nwords() : embedding->m_);
 
     for (size_t i = 0; i < n; i++) {
       int32_t idx = dict->getId(words[i]);
@@ -417,45 +597,77 @@ namespace fasttext {
     return model_->secondSimilarity(first_words, second_words);
   }
 
-  bool compare(std::pair<int32_t, real> first,
-               std::pair<int32_t, real> second) {
-    return (first.second > second.second);
-  }
-
   void PairText::findSimilarityWords(std::shared_ptr<Dictionary> dict,
-                                     std::shared_ptr<Matrix> embedding,
-                                     std::string& word, int32_t n) const {
+                                     const ExactIndex& exact,
+                                     std::shared_ptr<HnswIndex> index,
+                                     std::string& word, int32_t n, int32_t ef) const {
     int32_t id = dict->getId(word);
-    std::vector<std::pair<int32_t, real>> id2prob(dict->nwords());
-    Vector vec(args_->dim);
-    embedding->getRow(id, vec);
-    Vector curVec(args_->dim);
-    for (int32_t i = 0; i < dict->nwords(); i++) {
-      if (i != id) {
-        embedding->getRow(i, curVec);
-        real cos = cosine(vec, curVec);
-        id2prob[i] = std::make_pair(i, cos);
-      }
+    if (id < 0) return;
+    std::vector<std::vector<ExactIndex::Neighbor>> results(1);
+    std::vector<ExactIndex::Neighbor>& neighbors = results[0];
+    if (index) {
+      index->search(index->vector(id), n + 1, ef, neighbors);
+    } else {
+      exact.search(exact.vector(id), 1, n + 1, results);
     }
-    std::sort(id2prob.begin(), id2prob.end(), compare);
-    for (int i = 0; i < n; i++) {
-      std::cout << dict->getWord(id2prob[i].first) << " " << dict->getCount(id2prob[i].first) << " " << id2prob[i].second << std::endl;
+    int32_t printed = 0;
+    for (auto it = neighbors.cbegin(); it != neighbors.cend() && printed < n; ++it) {
+      if (it->second == id) continue;
+      std::cout << dict->getWord(it->second) << " " << dict->getCount(it->second) << " " << it->first << std::endl;
+      printed++;
     }
   }
 
-  void PairText::findSimilarityWords() const {
+  void PairText::findSimilarityWords(int32_t ef) const {
+    // 没有近邻索引的一侧做精确搜索, 词向量只归一化一次
+    ExactIndex firstExact, secondExact;
+    if (!firstIndex_) {
+      firstExact.build(*first_embedding_, first_dict_->nwords());
+    }
+    if (!secondIndex_) {
+      secondExact.build(*second_embedding_, second_dict_->nwords());
+    }
     int32_t dir;
     std::string word;
     int32_t n = 10;
     while (std::cin >> dir >> word >> n) {
       if (dir == 1) {
-        findSimilarityWords(first_dict_, first_embedding_, word, n);
+        findSimilarityWords(first_dict_, firstExact, firstIndex_, word, n, ef);
       } else if (dir == 2) {
-        findSimilarityWords(second_dict_, second_embedding_, word, n);
+        findSimilarityWords(second_dict_, secondExact, secondIndex_, word, n, ef);
       }
     }
   }
 
+  void PairText::buildIndex(const std::string& path, int32_t M,
+                            int32_t efConstruction, int32_t threads) {
+    firstIndex_ = std::make_shared<HnswIndex>();
+    firstIndex_->build(*first_embedding_, first_dict_->nwords(), M, efConstruction, threads, 0);
+    secondIndex_ = std::make_shared<HnswIndex>();
+    secondIndex_->build(*second_embedding_, second_dict_->nwords(), M, efConstruction, threads, 0);
+    std::ofstream first(path + ".first", std::ofstream::binary);
+    std::ofstream second(path + ".second", std::ofstream::binary);
+    if (!first.is_open() || !second.is_open()) {
+      std::cerr << "Index file cannot be opened for saving!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    firstIndex_->save(first);
+    secondIndex_->save(second);
+  }
+
+  void PairText::loadIndex(const std::string& path) {
+    std::ifstream first(path + ".first", std::ifstream::binary);
+    std::ifstream second(path + ".second", std::ifstream::binary);
+    if (!first.is_open() || !second.is_open()) {
+      std::cerr << "Index file cannot be opened for loading!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    firstIndex_ = std::make_shared<HnswIndex>();
+    firstIndex_->load(first, *first_embedding_, first_dict_->nwords());
+    secondIndex_ = std::make_shared<HnswIndex>();
+    secondIndex_->load(second, *second_embedding_, second_dict_->nwords());
+  }
+
   void PairText::validFunc(int32_t threadId, std::shared_ptr<real> pLoss, std::shared_ptr<int32_t> nexamples) const {
     std::ifstream ifs(args_->valid);
     utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
@@ -521,14 +733,30 @@ namespace fasttext {
   }
 
   void PairText::train(std::shared_ptr<Args> args) {
+    Matrix::hugePages = args->hugePages;
     if (args->input == "-") {
       // manage expectations
       std::cerr << "Cannot use stdin for training!" << std::endl;
       exit(EXIT_FAILURE);
     }
 
+    TrainState state;
     std::ifstream model_fs(args->output, std::ifstream::binary);
-    if (model_fs.is_open()) {
+    if (!args->resume.empty()) {
+      std::ifstream ckpt_fs(args->resume, std::ifstream::binary);
+      if (!ckpt_fs.is_open()) {
+        std::cerr << "Checkpoint file cannot be opened for resuming!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      loadModel(ckpt_fs);
+      args->restore(*args_);
+      args_ = args;
+      if (!state.load(ckpt_fs)) {
+        std::cerr << "Checkpoint file has no training state!" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      ckpt_fs.close();
+    } else if (model_fs.is_open()) {
       loadModel(model_fs);
       args_ = args;
     } else {
@@ -556,10 +784,12 @@ namespace fasttext {
   
 
       first_embedding_ = std::make_shared<Matrix>(first_dict_->nwords() + args_->bucket, args_->dim);
-      first_embedding_->uniform(1.0 / args_->dim);
+      first_embedding_->lazyUniform(1.0 / args_->dim,
+                                    args_->lazyBuckets ? first_dict_->nwords() : first_embedding_->m_);
 
       second_embedding_ = std::make_shared<Matrix>(second_dict_->nwords() + args_->bucket, args_->dim);
-      second_embedding_->uniform(1.0 / args_->dim);
+      second_embedding_->lazyUniform(1.0 / args_->dim,
+                                     args_->lazyBuckets ? second_dict_->nwords() : second_embedding_->m_);
 
       first_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
       second_w1_ = std::make_shared<Matrix>(args_->dim, args_->dim);
@@ -587,36 +817,84 @@ namespace fasttext {
     std::cout << "Total number of token: " << numToken << std::endl;
 
     start = clock();
-    tokenCount = 0;
-    real minValidLoss = std::numeric_limits<real>::max();
-    for (int32_t epoch = 0; epoch < args_->epoch; epoch++) {
+    tokenCount_ = std::make_shared<ProgressCounter>(args_->thread,
+                                                    state.tokenCount);
+    bestLoss_ = state.bestLoss;
+    positions_.reset(args_->thread, state.positions);
+    if (args_->workers > 1) {
+      cluster_ = std::make_shared<Cluster>(
+          args_, Cluster::Matrices{first_embedding_, first_w1_,
+                                   second_embedding_, second_w1_},
+          std::vector<bool>{true, false, true, false});
+    }
+    // 只有rank 0保存模型
+    bool saving = args_->rank == 0;
+    if (args_->checkpointInterval > 0 && saving) {
+      checkpointer_ = std::make_shared<Checkpointer>(
+          Checkpointer::Matrices{first_embedding_, first_w1_,
+                                 second_embedding_, second_w1_},
+          args_->checkpointInterval);
+    }
+    for (int32_t epoch = state.epoch; epoch < args_->epoch; epoch++) {
+      epoch_ = epoch;
       // train
+      std::vector<std::thread> readers;
+      if (args_->ioThread > 0) {
+        queue_ = std::make_shared<ExampleQueue>(
+            4 * std::max(args_->thread, args_->ioThread));
+        for (int32_t i = 0; i < args_->ioThread; i++) {
+          readers.push_back(std::thread([=]() { readThread(i); }));
+        }
+      }
+      std::atomic<bool> finished(false);
+      std::thread syncer;
+      if (cluster_) {
+        syncer = std::thread([=, &finished]() { syncThread(finished); });
+      }
       std::vector<std::thread> threads;
       for (int32_t i = 0; i < args_->thread; i++) {
         threads.push_back(std::thread([=]() { trainThread(i); }));
       }
+      if (queue_) {
+        for (auto it = readers.begin(); it != readers.end(); ++it) {
+          it->join();
+        }
+        queue_->close();
+      }
       for (auto it = threads.begin(); it != threads.end(); ++it) {
         it->join();
       }
+      queue_.reset();
+      if (cluster_) {
+        finished = true;
+        syncer.join();
+      }
+      positions_.reset(args_->thread);
       // valid
       real validLoss = valid();
       std::cout << "\nepoch = " << epoch << "  valid loss = " << validLoss << std::endl;
-      if (validLoss < minValidLoss) {
+      bool best = validLoss < bestLoss_;
+      if (best) {
         model_ = std::make_shared<PairModel>(first_embedding_,
                                              first_w1_,
                                              second_embedding_,
                                              second_w1_,
                                              args_, 0);
-
+        bestLoss_ = validLoss;
+      }
+      // the snapshot is written in background while the next epoch runs
+      if (checkpointer_) {
+        saveCheckpoint(epoch + 1, best, true);
+      } else if (best && saving) {
         saveModel();
-        if (args_->model != model_name::sup) {
-          saveVectors();
-        }
-        minValidLoss = std::min(minValidLoss, validLoss);
+      }
+      if (best && saving && args_->model != model_name::sup) {
+        saveVectors();
       }
     }
-
-
+    if (checkpointer_) {
+      checkpointer_->wait();
+    }
   }
 
 }
@@ -10,9 +10,16 @@
 #include <atomic>
 #include <memory>
 #include <future>
+#include "cache.h"
+#include "checkpoint.h"
+#include "cluster.h"
+#include "progress.h"
+#include "ring.h"
 #include "matrix.h"
 #include "vector.h"
 #include "dictionary.h"
+#include "hnsw.h"
+#include "knn.h"
 #include "pairmodel.h"
 #include "model.h"
 #include "utils.h"
@@ -26,6 +33,15 @@
 namespace fasttext {
 class PairText {
 private:
+  struct Example {
+    std::vector<std::pair<int32_t, real>> first;
+    std::vector<std::pair<int32_t, real>> second;
+    bool label;
+    real weight;
+    int64_t ntokens;
+  };
+  typedef BatchQueue<Example> ExampleQueue;
+
   std::shared_ptr<Args> args_;
   std::shared_ptr<Dictionary> first_dict_;
   std::shared_ptr<Matrix> first_embedding_;
@@ -36,9 +52,23 @@ private:
   std::shared_ptr<Matrix> second_w1_;
 
   std::shared_ptr<PairModel> model_;
-  std::atomic<int64_t> tokenCount;
+  std::shared_ptr<ProgressCounter> tokenCount_;
   std::atomic<int64_t> numToken;
   clock_t start;
+  std::shared_ptr<Checkpointer> checkpointer_;
+  FilePositions positions_;
+  int32_t epoch_;
+  real bestLoss_;
+  std::shared_ptr<ExampleQueue> queue_;
+  std::shared_ptr<Cluster> cluster_;
+  // 两侧文本到塔输出的缓存, 为空时不缓存
+  std::shared_ptr<EmbeddingCache> firstCache_;
+  std::shared_ptr<EmbeddingCache> secondCache_;
+  // 两侧词向量的近邻索引, 没有加载时为空
+  std::shared_ptr<HnswIndex> firstIndex_;
+  std::shared_ptr<HnswIndex> secondIndex_;
+
+  static const int32_t READ_BATCH_SIZE = 64;
 
 private:
   void getVector(std::shared_ptr<Dictionary>,
@@ -54,8 +84,16 @@ private:
    * @return 如果转换成功返回true, 否则返回false
    */
   bool convertLabel(const std::string&, bool&, real&) const;
+  bool readExample(std::ifstream&, Example&, std::minstd_rand&) const;
+
+  void findSimilarityWords(std::shared_ptr<Dictionary>, const ExactIndex&,
+                           std::shared_ptr<HnswIndex>, std::string&, int32_t, int32_t) const;
 
-  void findSimilarityWords(std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>, std::string&, int32_t) const;
+  /**
+   * 计算一侧的塔输出, 缓存命中时跳过分词和计算
+   * @return 词数, 少于30时输出无效
+   */
+  int32_t tower(bool first, const std::string&, InferenceSession&) const;
 
 public:
   void getFirstVector(Vector&, const std::string&);
@@ -64,6 +102,7 @@ public:
   void saveModel();
   void loadModel(const std::string&);
   void loadModel(std::istream&);
+  void saveCheckpoint(int32_t, bool, bool);
   void printInfo(real, real, real, real);
 
   void supervised(PairModel&, real,
@@ -76,6 +115,14 @@ public:
   void predict(std::istream&);
   real predictProbability(std::istream&) const;
   real predictProbability(const std::string& first, const std::string& second) const;
+  // 每个线程一个session, 可以并发调用
+  std::shared_ptr<InferenceSession> createSession(int32_t seed = 0) const;
+  real predictProbability(InferenceSession&, const std::string& first, const std::string& second) const;
+  // 每侧最多缓存entries个文本, 0关闭缓存
+  void setCacheSize(size_t entries);
+  void clearCache();
+  std::shared_ptr<EmbeddingCache> firstCache() const;
+  std::shared_ptr<EmbeddingCache> secondCache() const;
   void wordFirstVectors();
   void textFirstVectors(Vector&);
   void wordSecondVectors();
@@ -83,6 +130,8 @@ public:
   void printVectors();
   void printEmbedding();
   void trainThread(int32_t);
+  void readThread(int32_t);
+  void syncThread(const std::atomic<bool>&);
   void validFunc(int32_t, std::shared_ptr<real>, std::shared_ptr<int32_t>) const;
   real valid();
   void train(std::shared_ptr<Args>);
@@ -90,7 +139,10 @@ public:
   real firstSimilarity(const std::string&, const std::string&) const;
   real secondSimilarity(const std::string&, const std::string&) const;
 
-  void findSimilarityWords() const;
+  // 索引写到path.first和path.second
+  void buildIndex(const std::string& path, int32_t M, int32_t efConstruction, int32_t threads);
+  void loadIndex(const std::string& path);
+  void findSimilarityWords(int32_t ef) const;
 
   void loadVectors(std::string, std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>);
 };
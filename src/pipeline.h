@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_PIPELINE_H
+#define FASTTEXT_PIPELINE_H
+
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fasttext {
+
+/**
+ * Reader -> workers -> writer over a fixed pool of chunks. The calling
+ * thread reads chunks, the workers process them in any order and the writer
+ * consumes them in the order they were read. Chunks are recycled, so their
+ * buffers are allocated once.
+ */
+template <typename Chunk>
+class OrderedPipeline {
+  public:
+    // read returns false once the input is exhausted
+    typedef std::function<bool(Chunk&)> Reader;
+    typedef std::function<void(Chunk&, int32_t)> Worker;
+    typedef std::function<void(Chunk&)> Writer;
+
+    OrderedPipeline(int32_t workers, size_t chunks)
+      : workers_(workers), closed_(false) {
+      for (size_t i = 0; i < chunks; i++) {
+        pool_.push_back(std::unique_ptr<Chunk>(new Chunk()));
+        free_.push_back(pool_.back().get());
+      }
+    }
+
+    void run(const Reader& read, const Worker& work, const Writer& write) {
+      std::vector<std::thread> threads;
+      for (int32_t i = 0; i < workers_; i++) {
+        threads.push_back(std::thread([&, i]() { workThread(work, i); }));
+      }
+      std::thread writer([&]() { writeThread(write); });
+      for (int64_t seq = 0;; seq++) {
+        Chunk* chunk;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          freed_.wait(lock, [this]() { return !free_.empty(); });
+          chunk = free_.back();
+          free_.pop_back();
+        }
+        bool more = read(*chunk);
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!more) {
+          free_.push_back(chunk);
+          closed_ = true;
+          total_ = seq;
+          queued_.notify_all();
+          done_.notify_all();
+          break;
+        }
+        todo_.push_back(std::make_pair(seq, chunk));
+        queued_.notify_one();
+      }
+      for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+      }
+      writer.join();
+    }
+
+  private:
+    int32_t workers_;
+    std::vector<std::unique_ptr<Chunk>> pool_;
+    std::vector<Chunk*> free_;
+    std::deque<std::pair<int64_t, Chunk*>> todo_;
+    std::map<int64_t, Chunk*> processed_;
+    bool closed_;
+    int64_t total_;
+    std::mutex mutex_;
+    std::condition_variable freed_;
+    std::condition_variable queued_;
+    std::condition_variable done_;
+
+    void workThread(const Worker& work, int32_t worker) {
+      while (true) {
+        std::pair<int64_t, Chunk*> job;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          queued_.wait(lock, [this]() { return !todo_.empty() || closed_; });
+          if (todo_.empty()) {
+            return;
+          }
+          job = todo_.front();
+          todo_.pop_front();
+        }
+        work(*job.second, worker);
+        std::unique_lock<std::mutex> lock(mutex_);
+        processed_[job.first] = job.second;
+        done_.notify_all();
+      }
+    }
+
+    void writeThread(const Writer& write) {
+      for (int64_t next = 0;; next++) {
+        Chunk* chunk;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          done_.wait(lock, [this, next]() {
+            return processed_.count(next) > 0 || (closed_ && next >= total_);
+          });
+          if (processed_.count(next) == 0) {
+            return;
+          }
+          chunk = processed_[next];
+          processed_.erase(next);
+        }
+        write(*chunk);
+        std::unique_lock<std::mutex> lock(mutex_);
+        free_.push_back(chunk);
+        freed_.notify_one();
+      }
+    }
+};
+
+}
+
+#endif
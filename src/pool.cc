@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "pool.h"
+
+#include <algorithm>
+
+namespace fasttext {
+
+ThreadPool::ThreadPool(int32_t threads)
+  : threads_(std::max(threads, 1)), task_(nullptr), n_(0), next_(0),
+    generation_(0), running_(0), stop_(false) {
+  for (int32_t i = 1; i < threads_; i++) {
+    workers_.push_back(std::thread(&ThreadPool::workThread, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    it->join();
+  }
+}
+
+int32_t ThreadPool::size() const {
+  return threads_;
+}
+
+void ThreadPool::work(int32_t worker) {
+  while (true) {
+    size_t begin = next_.fetch_add(GRAIN);
+    if (begin >= n_) {
+      return;
+    }
+    size_t end = std::min(begin + GRAIN, n_);
+    for (size_t i = begin; i < end; i++) {
+      (*task_)(i, worker);
+    }
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const Task& task) {
+  std::lock_guard<std::mutex> loop(loop_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    n_ = n;
+    next_.store(0);
+    running_ = threads_ - 1;
+    generation_++;
+  }
+  start_.notify_all();
+  work(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return running_ == 0; });
+}
+
+void ThreadPool::workThread(int32_t worker) {
+  int64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, generation]() {
+        return stop_ || generation_ != generation;
+      });
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+    }
+    work(worker);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+}
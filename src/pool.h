@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_POOL_H
+#define FASTTEXT_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fasttext {
+
+/**
+ * Threads kept alive between parallel loops. The calling thread works as
+ * worker 0, so a pool of one thread starts none. Loops from several callers
+ * run one after the other.
+ */
+class ThreadPool {
+  public:
+    // index of the item, worker running it
+    typedef std::function<void(size_t, int32_t)> Task;
+
+    explicit ThreadPool(int32_t);
+    ~ThreadPool();
+
+    int32_t size() const;
+    // runs task on every index of [0, n) and waits for all of them
+    void parallelFor(size_t, const Task&);
+
+  private:
+    static const size_t GRAIN = 16;
+
+    int32_t threads_;
+    std::vector<std::thread> workers_;
+    std::mutex loop_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const Task* task_;
+    size_t n_;
+    std::atomic<size_t> next_;
+    int64_t generation_;
+    int32_t running_;
+    bool stop_;
+
+    void workThread(int32_t);
+    void work(int32_t);
+};
+
+}
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "progress.h"
+
+namespace fasttext {
+
+ProgressCounter::ProgressCounter(int32_t nthreads, int64_t start)
+  : slots_(nthreads), start_(start) {
+  for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+    it->count.store(0, std::memory_order_relaxed);
+  }
+}
+
+void ProgressCounter::add(int32_t thread, int64_t count) {
+  std::atomic<int64_t>& slot = slots_[thread].count;
+  slot.store(slot.load(std::memory_order_relaxed) + count,
+             std::memory_order_relaxed);
+}
+
+int64_t ProgressCounter::total() const {
+  int64_t total = start_;
+  for (auto it = slots_.cbegin(); it != slots_.cend(); ++it) {
+    total += it->count.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+}
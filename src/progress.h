@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_PROGRESS_H
+#define FASTTEXT_PROGRESS_H
+
+#include <atomic>
+#include <vector>
+
+namespace fasttext {
+
+/**
+ * Processed token count with one slot per trainer thread. Every slot has its
+ * own cache lines, so publishing a count never contends with other threads;
+ * only total() reads all of them, and trainers call it once per publish.
+ */
+class ProgressCounter {
+  private:
+    static const int32_t SLOT_SIZE = 128;
+
+    struct Slot {
+      std::atomic<int64_t> count;
+      char padding[SLOT_SIZE - sizeof(std::atomic<int64_t>)];
+    };
+
+    std::vector<Slot> slots_;
+    int64_t start_;
+
+  public:
+    ProgressCounter(int32_t nthreads, int64_t start);
+
+    void add(int32_t thread, int64_t count);
+    int64_t total() const;
+};
+
+}
+
+#endif
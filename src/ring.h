@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_RING_H
+#define FASTTEXT_RING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fasttext {
+
+/**
+ * Bounded multi-producer multi-consumer queue without locks. Every cell
+ * carries a sequence number telling producers and consumers whose turn it is,
+ * so the only shared writes are one compare-and-swap per operation.
+ */
+template <typename T>
+class RingBuffer {
+  private:
+    struct Cell {
+      std::atomic<size_t> sequence;
+      T data;
+    };
+
+    static const size_t PADDING = 64;
+
+    std::vector<Cell> cells_;
+    size_t mask_;
+    char pad0_[PADDING];
+    std::atomic<size_t> enqueue_;
+    char pad1_[PADDING];
+    std::atomic<size_t> dequeue_;
+    char pad2_[PADDING];
+
+  public:
+    // the capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) {
+        size *= 2;
+      }
+      cells_ = std::vector<Cell>(size);
+      mask_ = size - 1;
+      for (size_t i = 0; i < size; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      enqueue_.store(0, std::memory_order_relaxed);
+      dequeue_.store(0, std::memory_order_relaxed);
+    }
+
+    bool tryPush(const T& data) {
+      size_t pos = enqueue_.load(std::memory_order_relaxed);
+      while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq == pos) {
+          if (enqueue_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+            cell.data = data;
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (seq < pos) {
+          return false;
+        } else {
+          pos = enqueue_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    bool tryPop(T& data) {
+      size_t pos = dequeue_.load(std::memory_order_relaxed);
+      while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq == pos + 1) {
+          if (dequeue_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+            data = cell.data;
+            cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (seq < pos + 1) {
+          return false;
+        } else {
+          pos = dequeue_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+};
+
+/**
+ * Fixed pool of reusable example batches passed from reader threads to
+ * trainer threads through two rings: one of filled batches and one of free
+ * ones. Examples keep their allocations from one use to the next. A thread
+ * that finds its ring empty or full spins for a few tries, then sleeps until
+ * another thread pushes, releases or closes.
+ */
+template <typename Example>
+class BatchQueue {
+  public:
+    struct Batch {
+      std::vector<Example> examples;
+      size_t size;
+    };
+
+  private:
+    static const int32_t SPINS = 64;
+
+    std::vector<std::unique_ptr<Batch>> batches_;
+    RingBuffer<Batch*> full_;
+    RingBuffer<Batch*> free_;
+    std::atomic<bool> closed_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::atomic<int32_t> sleepers_;
+
+    // true once op succeeds, false when closed first
+    template <typename Op>
+    bool wait(Op op) {
+      for (int32_t i = 0; i < SPINS; i++) {
+        if (op()) return true;
+        if (closed_) return false;
+        std::this_thread::yield();
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        // pairs with the fence in signal: either the op sees the other
+        // thread's change or that thread sees a sleeper to wake
+        sleepers_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool done = op();
+        if (done || closed_) {
+          sleepers_.fetch_sub(1);
+          return done;
+        }
+        changed_.wait(lock);
+        sleepers_.fetch_sub(1);
+      }
+    }
+
+    void signal() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        changed_.notify_all();
+      }
+    }
+
+  public:
+    explicit BatchQueue(size_t capacity)
+      : full_(capacity), free_(capacity), closed_(false), sleepers_(0) {
+      for (size_t i = 0; i < capacity; i++) {
+        batches_.push_back(std::unique_ptr<Batch>(new Batch()));
+        batches_.back()->size = 0;
+        free_.tryPush(batches_.back().get());
+      }
+    }
+
+    // free batch to fill, nullptr once the queue is closed
+    Batch* acquire() {
+      Batch* batch;
+      if (closed_) {
+        return nullptr;
+      }
+      return wait([&]() { return free_.tryPop(batch); }) ? batch : nullptr;
+    }
+
+    void push(Batch* batch) {
+      if (wait([&]() { return full_.tryPush(batch); })) {
+        signal();
+      } else {
+        release(batch);
+      }
+    }
+
+    // filled batch, nullptr once the queue is closed and drained
+    Batch* pop() {
+      Batch* batch;
+      if (wait([&]() { return full_.tryPop(batch); })) {
+        signal();
+        return batch;
+      }
+      return full_.tryPop(batch) ? batch : nullptr;
+    }
+
+    void release(Batch* batch) {
+      free_.tryPush(batch);
+      signal();
+    }
+
+    void close() {
+      closed_ = true;
+      std::lock_guard<std::mutex> lock(mutex_);
+      changed_.notify_all();
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "rowbuffer.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace fasttext {
+
+RowBuffer::RowBuffer() : begin_(0), end_(0) {}
+
+void RowBuffer::reset(std::shared_ptr<Matrix> shared,
+                      int64_t begin, int64_t end) {
+  flush();
+  assert(begin >= 0 && begin <= end && end <= shared->m_);
+  shared_ = shared;
+  begin_ = begin;
+  end_ = end;
+  local_ = std::make_shared<Matrix>(end - begin, shared->n_);
+  delta_ = std::make_shared<Matrix>(end - begin, shared->n_);
+  dirty_.assign(end - begin, false);
+  touched_.clear();
+}
+
+real RowBuffer::dotRow(const Vector& vec, int64_t i) const {
+  assert(contains(i));
+  if (dirty_[i - begin_]) {
+    return local_->dotRow(vec, i - begin_);
+  }
+  return shared_->dotRow(vec, i);
+}
+
+void RowBuffer::addRowTo(Vector& vec, int64_t i, real alpha) const {
+  assert(contains(i));
+  if (dirty_[i - begin_]) {
+    vec.addRow(*local_, i - begin_, alpha);
+  } else {
+    vec.addRow(*shared_, i, alpha);
+  }
+}
+
+void RowBuffer::addRow(const Vector& vec, int64_t i, real alpha) {
+  assert(contains(i));
+  int64_t r = i - begin_;
+  int64_t n = shared_->n_;
+  if (!dirty_[r]) {
+    shared_->touchRow(i);
+    memcpy(local_->data_ + r * n, shared_->data_ + i * n, n * sizeof(real));
+    memset(delta_->data_ + r * n, 0, n * sizeof(real));
+    dirty_[r] = true;
+    touched_.push_back(r);
+  }
+  local_->addRow(vec, r, alpha);
+  delta_->addRow(vec, r, alpha);
+}
+
+void RowBuffer::flush() {
+  if (!shared_) {
+    return;
+  }
+  int64_t n = shared_->n_;
+  for (auto it = touched_.cbegin(); it != touched_.cend(); ++it) {
+    real* dst = shared_->data_ + (*it + begin_) * n;
+    const real* delta = delta_->data_ + *it * n;
+    for (int64_t j = 0; j < n; j++) {
+      dst[j] += delta[j];
+    }
+    dirty_[*it] = false;
+  }
+  touched_.clear();
+}
+
+}
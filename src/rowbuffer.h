@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_ROWBUFFER_H
+#define FASTTEXT_ROWBUFFER_H
+
+#include <memory>
+#include <vector>
+
+#include "matrix.h"
+#include "vector.h"
+#include "real.h"
+
+namespace fasttext {
+
+/**
+ * Thread-private write-back buffer for the rows [begin, end) of a shared
+ * matrix. A row is copied on its first update after a flush; reads and
+ * updates then use the private copy and the accumulated delta is added to
+ * the shared row on flush(). Rows outside the range are not handled here.
+ */
+class RowBuffer {
+  public:
+    RowBuffer();
+
+    void reset(std::shared_ptr<Matrix>, int64_t begin, int64_t end);
+    bool contains(int64_t i) const { return i >= begin_ && i < end_; }
+    real dotRow(const Vector&, int64_t) const;
+    void addRowTo(Vector&, int64_t, real alpha = 1.0) const;
+    void addRow(const Vector&, int64_t, real);
+    void flush();
+
+  private:
+    std::shared_ptr<Matrix> shared_;
+    std::shared_ptr<Matrix> local_;
+    std::shared_ptr<Matrix> delta_;
+    std::vector<bool> dirty_;
+    std::vector<int64_t> touched_;
+    int64_t begin_;
+    int64_t end_;
+};
+
+}
+
+#endif
@@ -0,0 +1,364 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include "utils.h"
+
+namespace fasttext {
+
+static const double LATENCY_BASE = 1.05;
+
+LatencyStats::LatencyStats()
+  : count_(0), start_(std::chrono::steady_clock::now()), last_(start_),
+    lastCount_(0) {
+  for (int32_t i = 0; i < NBUCKETS; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyStats::record(std::chrono::steady_clock::duration latency) {
+  double us = std::chrono::duration<double, std::micro>(latency).count();
+  int32_t bucket = 0;
+  if (us > 1.0) {
+    bucket = std::min<int32_t>(ceil(log(us) / log(LATENCY_BASE)),
+                               NBUCKETS - 1);
+  }
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// upper bound of the bucket holding the q-quantile, in microseconds
+double LatencyStats::quantile(double q) const {
+  int64_t total = 0;
+  for (int32_t i = 0; i < NBUCKETS; i++) {
+    total += buckets_[i].load(std::memory_order_relaxed);
+  }
+  int64_t rank = ceil(q * total), seen = 0;
+  for (int32_t i = 0; i < NBUCKETS; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) {
+      return pow(LATENCY_BASE, i);
+    }
+  }
+  return 0.0;
+}
+
+std::string LatencyStats::report() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  int64_t count = count_.load(std::memory_order_relaxed);
+  double total = std::chrono::duration<double>(now - start_).count();
+  double recent = std::chrono::duration<double>(now - last_).count();
+  char line[256];
+  snprintf(line, sizeof(line),
+           "requests %lld qps %.1f recent_qps %.1f p50_ms %.3f p99_ms %.3f",
+           (long long) count, count / total, (count - lastCount_) / recent,
+           quantile(0.5) / 1000, quantile(0.99) / 1000);
+  last_ = now;
+  lastCount_ = count;
+  return line;
+}
+
+/**
+ * A client socket: buffered line reads, and responses sent in request order.
+ * Workers only append responses to the output buffer and send what the
+ * socket takes without blocking; the connection's own thread waits for the
+ * socket to be writable and sends the rest, so a slow client only holds
+ * itself up. That thread stops reading requests while too many are
+ * unanswered or too many response bytes wait for the client.
+ */
+class Connection {
+  public:
+    explicit Connection(int fd) : fd_(fd), begin_(0), end_(0), next_(0),
+                                  pendingBytes_(0), sent_(0), open_(true),
+                                  waiting_(false) {
+      if (::pipe(wake_) != 0) {
+        std::cerr << "pipe: " << strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      for (int32_t i = 0; i < 2; i++) {
+        fcntl(wake_[i], F_SETFL, fcntl(wake_[i], F_GETFL) | O_NONBLOCK);
+      }
+    }
+    ~Connection() {
+      close(wake_[0]);
+      close(wake_[1]);
+      close(fd_);
+    }
+
+    // false once the client has closed its side
+    bool readLine(std::string& line) {
+      line.clear();
+      while (true) {
+        for (; begin_ < end_; begin_++) {
+          if (buffer_[begin_] == '\n') {
+            begin_++;
+            if (!line.empty() && line.back() == '\r') {
+              line.pop_back();
+            }
+            return true;
+          }
+          line.push_back(buffer_[begin_]);
+        }
+        if (!wait(true, []() { return false; })) {
+          return false;
+        }
+        ssize_t n = ::recv(fd_, buffer_, sizeof(buffer_), 0);
+        if (n <= 0) {
+          return !line.empty();
+        }
+        begin_ = 0;
+        end_ = n;
+      }
+    }
+
+    // sends the responses to the first count requests, after the client has
+    // closed its side
+    void drain(int64_t count) {
+      wait(false, [this, count]() {
+        return next_ >= count && sent_ == out_.size();
+      });
+    }
+
+    // waits, before request seq is read, until fewer than MAX_INFLIGHT
+    // requests are unanswered and fewer than MAX_BUFFERED response bytes
+    // are unsent. False once the client is gone
+    bool throttle(int64_t seq) {
+      return wait(false, [this, seq]() {
+        return seq - next_ < MAX_INFLIGHT &&
+               pendingBytes_ + out_.size() - sent_ < MAX_BUFFERED;
+      });
+    }
+
+    // queues the response of request seq once those before it are queued
+    void respond(int64_t seq, std::string& response) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (seq != next_) {
+        pendingBytes_ += response.size() + 1;
+        pending_[seq].swap(response);
+        return;
+      }
+      append(response);
+      next_++;
+      for (auto it = pending_.find(next_); it != pending_.end();
+           it = pending_.find(next_)) {
+        pendingBytes_ -= it->second.size() + 1;
+        append(it->second);
+        pending_.erase(it);
+        next_++;
+      }
+      flush();
+      if (open_ && (sent_ < out_.size() || waiting_)) {
+        char byte = 0;
+        ssize_t ignored = ::write(wake_[1], &byte, 1);
+        (void) ignored;
+      }
+    }
+
+  private:
+    static const int64_t MAX_INFLIGHT = 1024;
+    static const size_t MAX_BUFFERED = 1 << 20;
+
+    int fd_;
+    // written by workers to wake the connection's thread
+    int wake_[2];
+    char buffer_[1 << 16];
+    size_t begin_;
+    size_t end_;
+    std::mutex mutex_;
+    int64_t next_;
+    std::map<int64_t, std::string> pending_;
+    size_t pendingBytes_;
+    std::string out_;
+    size_t sent_;
+    bool open_;
+    // the connection's thread waits for responses
+    bool waiting_;
+
+    void append(const std::string& response) {
+      if (open_) {
+        out_.append(response);
+        out_.push_back('\n');
+      }
+    }
+
+    // sends what the socket takes without blocking, with mutex_ held
+    void flush() {
+      while (open_ && sent_ < out_.size()) {
+        ssize_t n = ::send(fd_, out_.data() + sent_, out_.size() - sent_,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          return;
+        }
+        if (n <= 0) {
+          // the client left, the remaining responses are dropped
+          open_ = false;
+          break;
+        }
+        sent_ += n;
+      }
+      out_.clear();
+      sent_ = 0;
+    }
+
+    // waits until done holds, checked with mutex_ held, or with readable
+    // until the socket is readable. Buffered responses are sent meanwhile.
+    // False once the client is gone
+    template <typename Done>
+    bool wait(bool readable, Done done) {
+      while (true) {
+        struct pollfd fds[2];
+        fds[0].fd = fd_;
+        fds[0].events = readable ? POLLIN : 0;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          waiting_ = !readable;
+          if (!open_ || done()) {
+            waiting_ = false;
+            return open_;
+          }
+          if (sent_ < out_.size()) {
+            fds[0].events |= POLLOUT;
+          }
+        }
+        fds[1].fd = wake_[0];
+        fds[1].events = POLLIN;
+        if (::poll(fds, 2, -1) < 0) {
+          if (errno == EINTR) continue;
+          return false;
+        }
+        if (fds[1].revents & POLLIN) {
+          char bytes[64];
+          while (::read(wake_[0], bytes, sizeof(bytes)) > 0) {}
+        }
+        if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          flush();
+        }
+        if (readable && (fds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+          return true;
+        }
+      }
+    }
+};
+
+Server::Server(int32_t lines, int32_t threads, int32_t maxBatch,
+               std::chrono::microseconds maxWait,
+               const SessionFactory& factory, const Handler& handler)
+  : lines_(lines), threads_(std::max(threads, 1)),
+    maxBatch_(std::max(maxBatch, 1)), maxWait_(maxWait), factory_(factory),
+    handler_(handler) {}
+
+void Server::serve(const std::string& address) {
+  int server = utils::openSocket(address, true);
+  if (::listen(server, SOMAXCONN) != 0) {
+    std::cerr << "listen: " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  for (int32_t i = 0; i < threads_; i++) {
+    std::thread(&Server::workThread, this, i).detach();
+  }
+  std::cerr << "Serving on " << address << " with " << threads_
+            << " threads" << std::endl;
+  while (true) {
+    int fd = accept(server, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      std::cerr << "accept: " << strerror(errno) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::thread(&Server::readThread, this,
+                std::make_shared<Connection>(fd)).detach();
+  }
+}
+
+void Server::readThread(std::shared_ptr<Connection> connection) {
+  for (int64_t seq = 0;; seq++) {
+    std::unique_ptr<Request> request(new Request());
+    if (!connection->throttle(seq)) {
+      return;
+    }
+    if (!connection->readLine(request->lines[0])) {
+      connection->drain(seq);
+      return;
+    }
+    if (request->lines[0] == "/stats") {
+      std::string report = stats_.report();
+      connection->respond(seq, report);
+      continue;
+    }
+    for (int32_t i = 1; i < lines_; i++) {
+      if (!connection->readLine(request->lines[i])) {
+        connection->drain(seq);
+        return;
+      }
+    }
+    request->connection = connection;
+    request->seq = seq;
+    request->start = std::chrono::steady_clock::now();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_.wait(lock, [this]() { return queue_.size() < MAX_QUEUE; });
+      queue_.push_back(request.release());
+    }
+    ready_.notify_one();
+  }
+}
+
+void Server::workThread(int32_t id) {
+  std::shared_ptr<InferenceSession> session = factory_(id);
+  std::vector<Request*> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return !queue_.empty(); });
+      auto deadline = std::chrono::steady_clock::now() + maxWait_;
+      while (true) {
+        while (!queue_.empty() && batch.size() < maxBatch_) {
+          batch.push_back(queue_.front());
+          queue_.pop_front();
+        }
+        if (batch.size() == maxBatch_ || maxWait_.count() == 0 ||
+            !ready_.wait_until(lock, deadline,
+                               [this]() { return !queue_.empty(); })) {
+          break;
+        }
+      }
+    }
+    space_.notify_all();
+    handler_(*session, batch);
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+      (*it)->connection->respond((*it)->seq, (*it)->response);
+      stats_.record(std::chrono::steady_clock::now() - (*it)->start);
+      delete *it;
+    }
+    batch.clear();
+  }
+}
+
+}
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_SERVER_H
+#define FASTTEXT_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "session.h"
+
+namespace fasttext {
+
+class Connection;
+
+/**
+ * Request latencies on a logarithmic histogram, 5% wide buckets from 1us.
+ */
+class LatencyStats {
+  private:
+    static const int32_t NBUCKETS = 512;
+
+    std::atomic<int64_t> buckets_[NBUCKETS];
+    std::atomic<int64_t> count_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_;
+    int64_t lastCount_;
+    std::mutex mutex_;
+
+    double quantile(double) const;
+
+  public:
+    LatencyStats();
+
+    void record(std::chrono::steady_clock::duration);
+    // requests, QPS since start and since the previous report, p50 and p99
+    std::string report();
+};
+
+/**
+ * Serves a model loaded once to clients of a Unix or TCP socket. A request
+ * is one line, or two for pair models, and gets one response line; a
+ * connection may send several requests before reading the responses, which
+ * come back in order. A worker takes up to maxBatch queued requests, waiting
+ * at most maxWait for more once it has the first, and scores them together
+ * with its own session. Readers stop taking requests while MAX_QUEUE wait
+ * for a worker. The line /stats is answered with the counters of
+ * LatencyStats.
+ */
+class Server {
+  public:
+    struct Request {
+      std::shared_ptr<Connection> connection;
+      int64_t seq;
+      std::string lines[2];
+      std::string response;
+      std::chrono::steady_clock::time_point start;
+    };
+    typedef std::function<std::shared_ptr<InferenceSession>(int32_t)>
+        SessionFactory;
+    // fills the response of every request, without the newline
+    typedef std::function<void(InferenceSession&, std::vector<Request*>&)>
+        Handler;
+
+    Server(int32_t lines, int32_t threads, int32_t maxBatch,
+           std::chrono::microseconds maxWait, const SessionFactory&,
+           const Handler&);
+    // accepts clients until the process is killed
+    void serve(const std::string& address);
+
+  private:
+    // requests waiting for a worker, across connections
+    static const size_t MAX_QUEUE = 4096;
+
+    int32_t lines_;
+    int32_t threads_;
+    size_t maxBatch_;
+    std::chrono::microseconds maxWait_;
+    SessionFactory factory_;
+    Handler handler_;
+    LatencyStats stats_;
+    std::deque<Request*> queue_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+
+    void readThread(std::shared_ptr<Connection>);
+    void workThread(int32_t);
+};
+
+}
+
+#endif
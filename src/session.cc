@@ -0,0 +1,20 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "session.h"
+
+namespace fasttext {
+
+InferenceSession::InferenceSession(int32_t dim, int32_t nlabels, int32_t seed)
+  : hidden(dim), output(nlabels),
+    firstInput(dim), firstHidden(dim), firstOutput(dim),
+    secondInput(dim), secondHidden(dim), secondOutput(dim),
+    rng(seed) {}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_SESSION_H
+#define FASTTEXT_SESSION_H
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+/**
+ * Scratch of one inference thread: tokenization buffers, hidden and output
+ * vectors and an rng. The model only reads its matrices while predicting, so
+ * threads with their own session may call it concurrently, and once the
+ * buffers have grown to the longest request a prediction allocates nothing.
+ */
+class InferenceSession {
+  public:
+    InferenceSession(int32_t dim, int32_t nlabels, int32_t seed);
+
+    std::string token;
+    // copies of texts handed over as pointer and length
+    std::string firstText;
+    std::string secondText;
+    std::vector<int32_t> words;
+    std::vector<int32_t> labels;
+    std::vector<std::pair<int32_t, real>> first;
+    std::vector<std::pair<int32_t, real>> second;
+    std::vector<std::pair<real, int32_t>> predictions;
+    std::vector<std::pair<real, int32_t>> frontier;
+    // exact predictions, to measure an approximate search against
+    std::vector<std::pair<real, int32_t>> reference;
+    // lines predicted together: the words of those with any, their
+    // predictions in the order of the lines, and scratch
+    std::vector<std::vector<int32_t>> batchWords;
+    std::vector<std::vector<std::pair<real, int32_t>>> batchHeaps;
+    std::vector<std::vector<std::pair<real, int32_t>>> batchPredictions;
+    std::vector<size_t> batchLines;
+    std::vector<real> batchScratch;
+    Vector hidden;
+    Vector output;
+    // the two towers of a pair model, or two text vectors
+    Vector firstInput;
+    Vector firstHidden;
+    Vector firstOutput;
+    Vector secondInput;
+    Vector secondHidden;
+    Vector secondOutput;
+    std::minstd_rand rng;
+};
+
+}
+
+#endif
@@ -9,6 +9,16 @@
 
 #include "utils.h"
 
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include <iostream>
 #include <cmath>
 #include <ios>
@@ -30,6 +40,70 @@ namespace utils {
     ifs.seekg(std::streampos(pos));
   }
 
+  static void failSocket(const std::string& what) {
+    std::cerr << what << ": " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  int openSocket(const std::string& address, bool server) {
+    int fd;
+    if (address.compare(0, 5, "unix:") == 0) {
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0) {
+        failSocket("socket");
+      }
+      if (server) {
+        unlink(addr.sun_path);
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+          failSocket("cannot bind " + address);
+        }
+      } else if (::connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+      }
+      return fd;
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      std::cerr << address << " should be host:port or unix:path"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                    &hints, &res) != 0) {
+      std::cerr << "cannot resolve " << address << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+      failSocket("socket");
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (server) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        failSocket("cannot bind " + address);
+      }
+    } else if (::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+  }
+
   std::vector<std::string> split(const std::string& line, char delim) {
     unsigned long start = 0;
     unsigned long end = 0;
@@ -24,6 +24,11 @@ namespace utils {
   std::vector<std::string> split(const std::string& line, char delim);
 
   std::string replace(const std::string &line, char old_char, char new_char);
+
+  // "unix:<path>" or "<host>:<port>"; a bound socket when server, otherwise
+  // a connected one or -1
+  int openSocket(const std::string& address, bool server);
+
   class Maths {
   private:
     void initSigmoid();
@@ -49,6 +49,7 @@ void Vector::addRow(const Matrix& A, int64_t i, real alpha) {
   assert(i >= 0);
   assert(i < A.m_);
   assert(m_ == A.n_);
+  A.touchRow(i);
   for (int64_t j = 0; j < A.n_; j++) {
     data_[j] += alpha * A.data_[i * A.n_ + j];
   }